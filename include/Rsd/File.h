@@ -11,7 +11,13 @@
 #ifndef __RSD_File_h__
 #define __RSD_File_h__
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <istream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -46,6 +52,83 @@ private:
 };
 
 
+/// This exception is thrown when a load is stopped by \ref FileLoad::cancel
+/// (or by setting LoadOptions::m_pCancel).
+class LoadCancelledException : public Exception
+{
+public:
+    LoadCancelledException() : Exception() { }
+
+    virtual ~LoadCancelledException() throw() { }
+
+    virtual const char* what() const throw()
+    {
+        return "The file load was cancelled!";
+    }
+};
+
+
+class Bundle;
+
+
+/// Settings controlling how a \ref File loads its data
+struct LoadOptions
+{
+    /// Should include statements be followed and their files loaded?
+    bool m_openIncludes;
+    /// When loading from a stream, parse it incrementally from chunks of this
+    /// many bytes rather than reading the whole stream into memory first.  Zero
+    /// reads the whole stream up front.
+    size_t m_streamChunkSize;
+    /// Number of threads used to read and parse include files in parallel.
+    /// Zero loads includes one after another on the calling thread.  Either
+    /// way the resulting tree and file numbering are the same.
+    size_t m_includeThreads;
+    /// Take files (the one being opened and its includes) from the
+    /// process-wide \ref IncludeCache, so each is only parsed once per
+    /// process while it is unchanged on disk.  Each File still gets its own
+    /// copy of every cached tree.
+    bool m_useIncludeCache;
+    /// With m_openIncludes, only record each include's path when loading, and
+    /// load and parse the include the first time a lookup (value(name),
+    /// find(), findByTypeName(), ...) has to search into it.  Lazy includes
+    /// are loaded once, and may be looked up from several threads at once.
+    /// Indexing or listing an include's values (size(), values(), [i]) loads
+    /// it too.  Each file is numbered when its include statement is reached,
+    /// whenever it is loaded, so file indices match an eager load.
+    bool m_lazyIncludes;
+    /// Number of threads to parse a single big file on, by splitting it
+    /// between top-level values; fixing up the parsed values is spread over
+    /// them too.  Zero or one parses on the calling thread.  The tree, line
+    /// numbers and errors are the same either way.  Streams parsed in chunks
+    /// and binary data are unaffected.
+    size_t m_parseThreads;
+    /// If set, loading looks at this flag before reading each file and
+    /// between parsing and opening includes, and throws a
+    /// LoadCancelledException once it is true.  Only the load itself is
+    /// stopped; lazy includes and reloads later are not affected.
+    std::shared_ptr< std::atomic<bool> > m_pCancel;
+    /// The bundle files are being read from instead of from disk; set when
+    /// File(filename) opens a bundle written by \ref File::writeBundle.
+    std::shared_ptr<const Bundle> m_pBundle;
+
+    /// Default settings open includes serially and buffer whole streams
+    LoadOptions(bool openIncludes = true)
+        : m_openIncludes(openIncludes),
+          m_streamChunkSize(0),
+          m_includeThreads(0),
+          m_useIncludeCache(false),
+          m_lazyIncludes(false),
+          m_parseThreads(0),
+          m_pCancel(),
+          m_pBundle() { }
+};
+
+
+class IncludeLoader;
+class FileLoad;
+class LineIndex;
+
 
 //
 // File
@@ -61,19 +144,35 @@ public:
 public:
     File();
     File(const std::string& filename,
-         bool openIncludes = true);
+         const LoadOptions& options = LoadOptions());
+    /// Load from a stream.  Set LoadOptions::m_streamChunkSize to parse the
+    /// stream as it arrives (e.g. from a pipe) with bounded input buffering.
     File(std::istream& inputStream,
          const std::string& streamName,
          const std::string& pathBase = ".",
-         bool openIncludes = true);
+         const LoadOptions& options = LoadOptions());
     File(const std::string& bufferString,
          const std::string& bufferName,
          const std::string& pathBase = ".",
-         bool openIncludes = true);
+         const LoadOptions& options = LoadOptions());
     File(const char* buffer,
          const std::string& bufferName,
          const std::string& pathBase = ".",
-         bool openIncludes = true);
+         const LoadOptions& options = LoadOptions());
+
+    /// \brief Load a file on a background thread.
+    ///
+    /// Reading, parsing, context fixup and include processing all happen in
+    /// the background, exactly as the File(filename, options) constructor
+    /// would do them.  The returned \ref FileLoad gives the file once it is
+    /// ready, rethrowing FileIOException or Parser::ParseException if the
+    /// load failed, and can cancel the load.  If given, onLoaded is called on
+    /// the loading thread once the load has finished (or failed), and may
+    /// call \ref FileLoad::get without blocking.
+    static FileLoad loadAsync(const std::string& filename,
+                              const LoadOptions& options = LoadOptions(),
+                              const std::function<void (const FileLoad&)>& onLoaded =
+                                  std::function<void (const FileLoad&)>());
 
 
     //
@@ -147,18 +246,74 @@ public:
                bool followIncludes = false,
                size_t indentation = 0);
 
+    /// \brief Write this file's data in the compact binary RSD format (.rsdb).
+    ///
+    /// Binary data loads back through the same constructors as text (it is
+    /// detected automatically) with no tokenizing or parsing.  Include
+    /// statements are written as include statements, and every value keeps
+    /// the line and position it was parsed from.  Throws a FileIOException
+    /// if the stream could not be written.
+    void writeBinary(std::ostream& stream) const;
+
+    /// Write this file's data to a file in the binary format.  See the other
+    /// \ref writeBinary method docs for more info.
+    void writeBinary(const std::string& filename) const;
+
+    /// \brief Pack a file and every file it transitively includes into one
+    /// bundle archive (.rsda).
+    ///
+    /// Files are stored as they are on disk, under their paths relative to
+    /// the root file.  Opening the bundle with File(filename) loads the root
+    /// file from it, and takes every include from it as well, all from a
+    /// single mapping of the bundle.  Files read from a bundle are not
+    /// checked by \ref reload.  Throws FileIOException if a file could not
+    /// be read or the bundle written, or Parser::ParseException if a file
+    /// could not be parsed to find its includes.
+    static void writeBundle(const std::string& rootFilename,
+                            const std::string& bundleFilename);
+
+
+    //
+    // Reloading
+    //
+
+    /// \brief Re-read the files this was loaded from that changed on disk.
+    ///
+    /// Each file this was opened from by filename (this file itself, and
+    /// every include that has been loaded) is checked by its modification
+    /// time and size.  Only changed files are parsed again, and their new
+    /// contents replace the old ones in place: the \ref File for a changed
+    /// include stays the same object, and includes of a changed file that did
+    /// not change themselves are reattached as they are, so pointers into
+    /// unchanged files stay valid.  Newly included files are opened with the
+    /// options the changed file was loaded with.  Lazy includes that have not
+    /// been loaded yet are left for later.
+    ///
+    /// Throws FileIOException or Parser::ParseException if a changed file
+    /// could not be read or parsed, leaving that file's old contents in place.
+    /// The tree must not be used from other threads while reloading.
+    /// @return The number of files that were parsed again.
+    size_t reload();
+
+    /// Every file on disk this was loaded from: this file itself, if it was
+    /// opened by filename, and each include that has been loaded
+    std::vector<std::string> sourceFiles() const;
+
 
     //
     // Textual representation
     //
 
-    /// Serialize this node's data to a string.
+    /// Serialize this node's data straight into a stream; \ref str gives the
+    /// same text as a string.
+    /// @param stream         The stream to write to.
     /// @param followIncludes Optional, whether includes should be replaced by the contents of each include file.
     /// @param keepInline     Optional, whether to keep all output on one line.
     /// @param indentation    Optional, how far to indent the written data, useful for indicating nesting (internally, 4 spaces are used for each recursive indentation level).
-    virtual std::string str(bool followIncludes = false,
-                            bool keepInline = false,
-                            size_t indentation = 0) const;
+    virtual void serialize(std::ostream& stream,
+                           bool followIncludes = false,
+                           bool keepInline = false,
+                           size_t indentation = 0) const;
 
 protected:
     virtual ~File();
@@ -168,22 +323,180 @@ protected:
     typedef std::vector<std::string> FileIndexMap;
     FileIndexMap m_fileIndexMap;
 
-    /// Parse a string buffer of data, and assign newly created nodes the file
+    /// Parse a buffer of data, and assign newly created nodes the file
     /// index.  Throws on parser errors.
-    void openBuffer(const std::string& input,
+    void openBuffer(const char* input,
+                    size_t length,
                     FileIndexMap& fileIndexMap,
                     const std::string& pathBase = ".",
-                    bool openIncludes = true);
+                    const LoadOptions& options = LoadOptions());
 
-    /// Fixup a value and process includes if necessary
+    /// Parse a stream incrementally in chunks of options.m_streamChunkSize
+    /// bytes, and assign newly created nodes the file index.  Throws on
+    /// parser errors.
+    void openStream(std::istream& inputStream,
+                    FileIndexMap& fileIndexMap,
+                    const std::string& pathBase = ".",
+                    const LoadOptions& options = LoadOptions());
+
+    /// Take the contents of an already-parsed file (copying them), and assign
+    /// nodes the file index.
+    void openParsed(const File& parsed,
+                    FileIndexMap& fileIndexMap,
+                    const std::string& pathBase = ".",
+                    const LoadOptions& options = LoadOptions());
+
+    /// Load this include's file if it was left for later by
+    /// LoadOptions::m_lazyIncludes
+    virtual void loadDeferredValues() const;
+
+    /// Fixup a value and process includes if necessary.  If an include
+    /// loader is given, includes are taken from it already parsed rather
+    /// than being opened here.  When reloading, includes of the same file
+    /// are taken from the reload state instead of being opened again.
+    struct ReloadState;
     void processValue(Value& v,
                       FileIndex fileIndex,
                       FileIndexMap& fileIndexMap,
                       const std::string& pathBase,
-                      bool openIncludes = true);
+                      const LoadOptions& options = LoadOptions(),
+                      IncludeLoader* pIncludeLoader = NULL,
+                      ReloadState* pReload = NULL);
+    /// The part of processValue for one of v's values (the ith)
+    void processMember(Value& v,
+                       size_t i,
+                       FileIndex fileIndex,
+                       FileIndexMap& fileIndexMap,
+                       const std::string& pathBase,
+                       const LoadOptions& options,
+                       IncludeLoader* pIncludeLoader,
+                       ReloadState* pReload);
+    /// fixupContexts(), spread over LoadOptions::m_parseThreads threads by
+    /// top-level value when there are plenty of them
+    void fixupContextsOnThreads(const LoadOptions& options);
+    /// processValue(*this, ...), numbering top-level values that hold no
+    /// includes on LoadOptions::m_parseThreads threads when there are plenty
+    /// of them, and then seeing to the rest in order
+    void processValues(FileIndex fileIndex,
+                       FileIndexMap& fileIndexMap,
+                       const std::string& pathBase,
+                       const LoadOptions& options,
+                       IncludeLoader* pIncludeLoader = NULL);
+
+    /// Parse (or decode, for binary data) into this file, leaving contexts
+    /// and includes for later.  Parse errors are reported against sourceName.
+    void parseInput(const char* input,
+                    size_t length,
+                    std::istream* pInputStream,
+                    const std::string& sourceName,
+                    const LoadOptions& options);
+
+    /// Replace our contents with a copy of those of another parsed file, and
+    /// fix up contexts
+    void copyParsed(const File& parsed);
+
+    /// Read and parse a file into this one, leaving its includes unopened;
+    /// from the include cache if the options say so
+    void readFile(const std::string& filename,
+                  const LoadOptions& options);
+
+    /// Open a file's contents; from the include cache if the options say so
+    void openFile(const std::string& filename,
+                  FileIndexMap& fileIndexMap,
+                  const std::string& pathBase,
+                  const LoadOptions& options);
+
+private:
+    friend class IncludeLoader;
+    friend class IncludeCache;
+
+    /// Shared by openBuffer/openStream/openParsed; copies the parsed file if
+    /// one is given, else parses from the stream if one is given, otherwise
+    /// from the buffer.
+    void openInput(const char* input,
+                   size_t length,
+                   std::istream* pInputStream,
+                   const File* pParsed,
+                   FileIndexMap& fileIndexMap,
+                   const std::string& pathBase,
+                   const LoadOptions& options);
 
     /// Map a file index to a filename, if available
     virtual std::string file(FileIndex index) const;
+
+    /// Map an offset into this file (or one it includes) to a line and column
+    virtual bool locate(FileIndex index, size_t offset, size_t& outLine, size_t& outColumn) const;
+
+    /// Remember which file this was read from and how, for \ref reload
+    void recordSource(const std::string& filename,
+                      const std::string& pathBase,
+                      const LoadOptions& options);
+
+    /// Parse this file again if it changed on disk, otherwise look for
+    /// changes in its includes
+    void reloadChanged(size_t& numReloaded);
+
+    /// Where to load a lazy include from, until it is loaded
+    struct DeferredInclude;
+    std::unique_ptr<DeferredInclude> m_pDeferredInclude;
+    mutable std::mutex m_deferredIncludeMutex;
+
+    /// Where this file was read from, and what it looked like on disk then
+    struct SourceFile;
+    std::unique_ptr<SourceFile> m_pSource;
+
+    /// Where the lines of this file's text start, for the line and position
+    /// of its values; shared with copies of the file
+    std::shared_ptr<const LineIndex> m_pLineIndex;
+};
+
+
+/// \brief A \ref File being loaded in the background by \ref File::loadAsync.
+///
+/// Copies share the same load.  Dropping every copy does not stop the load;
+/// call \ref cancel for that.
+class FileLoad
+{
+public:
+    /// An invalid load, with nothing to wait for
+    FileLoad() : m_future(), m_pCancel() { }
+
+    /// Is there a load to wait for?
+    bool valid() const { return m_future.valid(); }
+
+    /// Has the load finished (or failed)?
+    bool isReady() const;
+
+    /// Wait for the load to finish
+    void wait() const { m_future.wait(); }
+
+    /// Wait up to the given time for the load to finish; true if it did
+    bool waitFor(const std::chrono::milliseconds& timeout) const;
+
+    /// Wait for the load and get the file.  Rethrows whatever the load threw:
+    /// FileIOException, Parser::ParseException, or LoadCancelledException.
+    File::FilePtr get() const { return m_future.get(); }
+
+    /// The underlying future, e.g. to wait on several loads
+    const std::shared_future<File::FilePtr>& future() const { return m_future; }
+
+    /// Ask the load to stop as soon as it can.  Loads that already finished
+    /// keep their result.
+    void cancel()
+    {
+        if (m_pCancel)
+            m_pCancel->store(true, std::memory_order_relaxed);
+    }
+
+private:
+    friend class File;
+
+    FileLoad(const std::shared_future<File::FilePtr>& future,
+             const std::shared_ptr< std::atomic<bool> >& pCancel)
+        : m_future(future), m_pCancel(pCancel) { }
+
+    std::shared_future<File::FilePtr> m_future;
+    std::shared_ptr< std::atomic<bool> > m_pCancel;
 };
 
 
@@ -0,0 +1,81 @@
+////////////
+//
+//  File:      FileWatcher.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Reload a file when it or its includes change on disk
+//
+////////////
+
+#ifndef __RSD_FileWatcher_h__
+#define __RSD_FileWatcher_h__
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <Rsd/File.h>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+/// \brief Watches the files a \ref File was loaded from, and reloads it when
+/// any of them change.
+///
+/// On Linux this uses inotify on the directories holding the files, so
+/// editors that save by writing a new file and renaming it over the old one
+/// are caught too.  Elsewhere, \ref poll just waits and then lets
+/// \ref File::reload check every file's modification time.
+///
+/// Nothing happens in the background: changes are only picked up, and the
+/// file reloaded, on the thread calling \ref poll, so an interactive session
+/// can call it from its event loop without the tree changing underneath it.
+class FileWatcher
+{
+public:
+    explicit FileWatcher(File::FilePtr pFile);
+    ~FileWatcher();
+
+    /// Wait up to timeoutMilliseconds (zero just checks, negative waits
+    /// forever) for any of the file's sources to change, then reload the
+    /// file.  Throws whatever \ref File::reload throws.
+    /// @return The number of files that were parsed again.
+    size_t poll(int timeoutMilliseconds = 0);
+
+    /// Is the platform telling us about changes, rather than \ref poll
+    /// having to check every file?
+    bool isNotified() const { return m_fd >= 0; }
+
+    File::FilePtr file() const { return m_pFile; }
+
+private:
+    // Forbidden
+    FileWatcher(const FileWatcher&);
+    FileWatcher& operator =(const FileWatcher&);
+
+    /// Start watching the directories of any source files not yet watched
+    void watchSourceFiles();
+
+    /// Wait for and read pending notifications; true if any were about one
+    /// of the source files
+    bool readNotifications(int timeoutMilliseconds);
+
+    File::FilePtr m_pFile;
+    int m_fd;
+    /// Watched directory for each watch descriptor
+    std::map<int, std::string> m_watchedDirectories;
+    /// Source files, as (canonical) directory and name within it
+    std::set<std::pair<std::string, std::string> > m_watchedFiles;
+};
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_FileWatcher_h__
@@ -0,0 +1,111 @@
+////////////
+//
+//  File:      IncludeCache.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Process-wide cache of parsed files
+//
+////////////
+
+#ifndef __RSD_IncludeCache_h__
+#define __RSD_IncludeCache_h__
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <Rsd/File.h>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+/// \brief Process-wide cache of parsed files, shared by every \ref File.
+///
+/// Files loaded with LoadOptions::m_useIncludeCache (and the includes they
+/// open) are parsed once per process and kept here, keyed on the canonical
+/// path plus the file's modification time and size, so an edited file is
+/// parsed again.  Cached trees are the bare parse of each file with its
+/// includes left unopened, and are never modified.
+///
+/// The cache saves parsing, not memory: trees are not shared between Files.
+/// Each File loading a cached file deep-copies its tree, paying for the
+/// copy in time and memory every time, because every Value records its own
+/// context (the block it is in), the file number it came from within its
+/// File, and may be changed after loading, so one tree cannot sit in several
+/// Files at once.
+///
+/// When the estimated memory held by the cached trees goes over the budget,
+/// the least recently used files are evicted.  The budget covers only the
+/// cache's own trees, not the copies in Files.  All methods are thread-safe.
+class IncludeCache
+{
+public:
+    /// The cache shared by the whole process
+    static IncludeCache& instance();
+
+    /// Get the parsed contents of a file, parsing it if it is not cached or
+    /// has changed on disk.  Throws FileIOException if the file could not be
+    /// opened, or Parser::ParseException on syntax errors.
+    File::ConstFilePtr acquire(const std::string& filename);
+
+    /// Drop everything from the cache
+    void clear();
+
+    /// Estimated memory the cache may hold before evicting, in bytes
+    size_t memoryBudget() const;
+    void   setMemoryBudget(size_t bytes);
+
+    /// Estimated memory currently held by cached files, in bytes
+    size_t memoryUsed() const;
+    /// Number of cached files
+    size_t size() const;
+
+    size_t numHits() const;
+    size_t numMisses() const;
+    size_t numEvictions() const;
+
+private:
+    IncludeCache();
+    ~IncludeCache();
+
+    // Forbidden
+    IncludeCache(const IncludeCache&);
+    IncludeCache& operator =(const IncludeCache&);
+
+    struct Entry
+    {
+        std::string m_path;
+        long long m_modifiedTime;
+        long long m_size;
+        size_t m_memory;
+        File::ConstFilePtr m_pFile;
+    };
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<std::string, EntryList::iterator> EntryMap;
+
+    /// Evict least recently used entries until under budget; needs the lock
+    void evict();
+
+    mutable std::mutex m_mutex;
+    /// Most recently used at the front
+    EntryList m_entries;
+    EntryMap m_entryMap;
+    size_t m_memoryBudget;
+    size_t m_memoryUsed;
+    size_t m_numHits;
+    size_t m_numMisses;
+    size_t m_numEvictions;
+};
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_IncludeCache_h__
@@ -12,6 +12,7 @@
 #define __RSD_Parser_h__
 
 #include <string>
+#include <istream>
 #include <exception>
 
 #include <Rsd/Value.h>
@@ -21,21 +22,155 @@ namespace RenderSpud
 {
     namespace Rsd
     {
+
+
+class LineIndex;
+
+
         namespace Parser
         {
 
 
+class ParseArena;
+
+
+/// \brief What a parser keeps from one parse to the next: the state of the
+/// lemon parsers, the arena for the grammar's intermediate values, and the
+/// line index of the input.
+///
+/// Setting these up is most of the work of parsing something tiny such as a
+/// reference, so parsers reuse a context rather than starting from scratch.
+/// Once a context has been through a parse or two, parsing a short reference
+/// allocates nothing but the Reference itself.  A context is only used by
+/// one parse at a time; each thread has its own default one, and a parse
+/// that finds its context busy (such as a parse started from within
+/// another) uses a fresh context of its own.
+class ParseContext
+{
+public:
+    ParseContext();
+    ~ParseContext();
+
+    /// The calling thread's context, used by parsers not given one
+    static ParseContext& threadDefault();
+
+private:
+    // Forbidden
+    ParseContext(const ParseContext&);
+    ParseContext& operator =(const ParseContext&);
+
+    friend class ContextUse;
+
+    ParseArena *m_pArena;
+    LineIndex *m_pLines;
+    void *m_pMainParser;
+    void *m_pReferenceParser;
+    bool m_inUse;
+};
+
+
+/// \brief Told what a parse finds, in the order it appears in the input,
+/// instead of the parse building it into values.
+///
+/// A block's or the file's members each come as a name, then the member's
+/// type name (if it has one), then its value.  Blocks and arrays come as a
+/// begin, their members or elements, and an end.  References and macros are
+/// built and reported whole, subscripts and arguments and all.  Includes are
+/// only reported, not loaded.  Every event does nothing unless overridden,
+/// and nothing else is built, so a handler only pays for what it looks at.
+class ParseHandler
+{
+public:
+    virtual ~ParseHandler() { }
+
+    /// The name of the next member of the enclosing block (or the file)
+    virtual void name(const std::string& name) { }
+    /// The type name of the next value
+    virtual void typeName(const TypeName& typeName) { }
+
+    /// A block starts, inheriting from pInheritFrom if it is not NULL
+    virtual void beginBlock(const Reference* pInheritFrom, size_t offset) { }
+    virtual void endBlock() { }
+    virtual void beginArray(size_t offset) { }
+    virtual void endArray() { }
+
+    virtual void booleanValue(bool value, size_t offset) { }
+    virtual void integerValue(long value, size_t offset) { }
+    virtual void floatValue(double value, size_t offset) { }
+    virtual void stringValue(const std::string& value, size_t offset) { }
+    virtual void reference(const Reference& ref, size_t offset) { }
+    virtual void macro(const MacroInvocation& macro, size_t offset) { }
+
+    /// An include statement, naming the file it includes
+    virtual void include(const std::string& filename, size_t offset) { }
+};
+
+
 /// Main parser class for RSD files
 class Parser
 {
 public:
-    Parser() { }
+    Parser() : m_numThreads(1), m_pContext(NULL) { }
+
+    /// Parse using the given context rather than the calling thread's
+    /// default one (NULL goes back to the default).  The context must outlive
+    /// the parser's use of it.
+    void setContext(ParseContext* pContext) { m_pContext = pContext; }
+    ParseContext* context() const           { return m_pContext; }
+
+    /// Parse big buffers on up to this many threads, by splitting them
+    /// between top-level values (at semicolons outside any brackets, strings
+    /// and comments) and parsing the pieces at once.  The values, their
+    /// offsets and any error are the same as parsing on one thread.  Streams
+    /// are always parsed on the calling thread.
+    void setNumThreads(size_t numThreads) { m_numThreads = numThreads; }
+    size_t numThreads() const             { return m_numThreads; }
 
     /// Parse into a block value
-    void parse(const std::string& input, Value& root);
+    void parse(const std::string& input, Value& root)
+    {
+        parse(input.data(), input.length(), root);
+    }
+
+    /// Parse a raw buffer (such as a memory-mapped file) into a block value.
+    /// The buffer need not be null-terminated.  Values remember the offset
+    /// they were parsed at; if pOutLines is given, the line starts of the
+    /// input are indexed into it for turning those into lines and columns.
+    void parse(const char* input, size_t length, Value& root, LineIndex* pOutLines = NULL);
+
+    /// Parse a stream incrementally, reading it in chunks of chunkSize bytes.
+    /// Only the unconsumed tail of the current chunk is held in memory, so the
+    /// parse runs while whatever is producing the stream is still writing.
+    void parse(std::istream& input, size_t chunkSize, Value& root, LineIndex* pOutLines = NULL);
+
+    /// Parse, telling handler what is found rather than building values
+    void parse(const std::string& input, ParseHandler& handler)
+    {
+        parse(input.data(), input.length(), handler);
+    }
+
+    /// Parse a raw buffer, telling handler what is found rather than building
+    /// values.  Always parses on the calling thread, to keep the events in
+    /// order.
+    void parse(const char* input, size_t length, ParseHandler& handler, LineIndex* pOutLines = NULL);
+
+    /// Parse a stream incrementally, telling handler what is found
+    void parse(std::istream& input, size_t chunkSize, ParseHandler& handler, LineIndex* pOutLines = NULL);
 
     /// Parse into a reference
-    void parseReference(const std::string& input, Reference& ref);
+    void parseReference(const std::string& input, Reference& ref)
+    {
+        parseReference(input.data(), input.length(), ref);
+    }
+
+    /// Parse a raw buffer into a reference.  Plain dotted paths with integer
+    /// and string subscripts, such as a.b[3]["x"], are parsed directly; only
+    /// anything fancier goes through the tokenizer and grammar.
+    void parseReference(const char* input, size_t length, Reference& ref);
+
+private:
+    size_t m_numThreads;
+    ParseContext *m_pContext;
 };
 
 
@@ -43,23 +178,35 @@ public:
 // Parser help
 //
 
-/// Parser helper; used during parsing to remember the current lines, track stats, etc.
+/// Parser helper; used during parsing to remember the current offset, track
+/// stats, etc.  The grammar's intermediate values live in the arena.
 struct ParserState
 {
     Value *m_pRoot;
     Reference *m_pRootReference;
     std::string m_currentSource;
-    size_t m_currentLine;
-    size_t m_currentPosition;
+    size_t m_currentOffset;
+    const LineIndex *m_pLineIndex;
+    ParseArena *m_pArena;
     size_t m_numTokensDestroyed;
+    // Reporting to a handler rather than building values: how deep in
+    // macros the parse is (which are built regardless), and the reference
+    // the next block inherits from
+    ParseHandler *m_pHandler;
+    size_t m_buildDepth;
+    Reference::Ptr m_pInheritFrom;
 
     ParserState(Value& root)
         : m_pRoot(&root),
           m_pRootReference(NULL),
           m_currentSource(),
-          m_currentLine(1),
-          m_currentPosition(0),
-          m_numTokensDestroyed(0)
+          m_currentOffset(0),
+          m_pLineIndex(NULL),
+          m_pArena(NULL),
+          m_numTokensDestroyed(0),
+          m_pHandler(NULL),
+          m_buildDepth(0),
+          m_pInheritFrom()
     {
 
     }
@@ -68,12 +215,38 @@ struct ParserState
         : m_pRoot(NULL),
           m_pRootReference(&root),
           m_currentSource(),
-          m_currentLine(1),
-          m_currentPosition(0),
-          m_numTokensDestroyed(0)
+          m_currentOffset(0),
+          m_pLineIndex(NULL),
+          m_pArena(NULL),
+          m_numTokensDestroyed(0),
+          m_pHandler(NULL),
+          m_buildDepth(0),
+          m_pInheritFrom()
+    {
+
+    }
+
+    ParserState(ParseHandler& handler)
+        : m_pRoot(NULL),
+          m_pRootReference(NULL),
+          m_currentSource(),
+          m_currentOffset(0),
+          m_pLineIndex(NULL),
+          m_pArena(NULL),
+          m_numTokensDestroyed(0),
+          m_pHandler(&handler),
+          m_buildDepth(0),
+          m_pInheritFrom()
     {
 
     }
+
+    /// Should the rules tell the handler what they find, rather than build
+    /// values out of it?
+    bool reporting() const { return m_pHandler != NULL && m_buildDepth == 0; }
+
+    /// Line (from 1) and column (from 0) of an offset into the input
+    void locate(size_t offset, size_t& outLine, size_t& outColumn) const;
 };
 
 
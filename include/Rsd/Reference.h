@@ -73,6 +73,13 @@ public:
     /// Invoke reference expression parser to parse a string
     static Reference::Ptr fromString(const std::string& refStr);
 
+    /// Like fromString, but the reference comes from a bounded cache of
+    /// recently parsed ones shared by all threads, so asking for the same
+    /// string again costs a hash lookup rather than a parse.  The reference
+    /// is shared with everyone else asking, so must not be changed (clone it
+    /// first, if need be).
+    static Reference::ConstPtr fromStringCached(const std::string& refStr);
+
     /// Get what kind this part in the reference is
     static PartType getPartType(const Part& p);
 
@@ -11,6 +11,8 @@
 #ifndef __RSD_Value_h__
 #define __RSD_Value_h__
 
+#include <atomic>
+#include <ostream>
 #include <string>
 #include <map>
 #include <vector>
@@ -94,6 +96,8 @@ typedef std::vector< RenderSpud::Ptr<const Value> > ConstValueArray;
 const size_t kNotFromFile = std::numeric_limits<size_t>::max();
 /// Special value denoting there is no index for the value
 const size_t kInvalidIndex = std::numeric_limits<size_t>::max();
+/// Special value denoting the node was not parsed from anywhere in its file
+const size_t kNoOffset = std::numeric_limits<size_t>::max();
 
 class Value : public ReferenceCounted
 {
@@ -130,14 +134,20 @@ public:
     Value(double f);
     /// Construct a string value
     Value(const std::string& s);
+    /// Construct a string value, taking over the string's storage
+    Value(std::string&& s);
     /// Construct a macro value
     Value(MacroInvocation::Ptr pMacroInvocation);
     /// Construct a reference value
     Value(Reference::Ptr pReference);
     /// Construct an array value
     Value(ValueArray& arrayValues);
+    /// Construct an array value, taking over the array's storage
+    Value(ValueArray&& arrayValues);
     /// Construct a block value
     Value(const std::vector<std::string>& names, ValueArray& blockValues);
+    /// Construct a block value, taking over the storage of the names and values
+    Value(std::vector<std::string>&& names, ValueArray&& blockValues);
     /// Construct a value of a given type (but empty/zero/etc)
     Value(Type type);
 
@@ -168,15 +178,19 @@ public:
 
     /// For values read from a file, the file it came from.
     std::string file() const { return file(m_fileIndex); }
-    /// For values read from a file, the line it came from.
-    size_t      line() const { return m_line; }
-    /// For values read from a file, the position within the line it came from.
-    size_t      pos()  const { return m_pos; }
-
-    // For the parser: set line/pos.  Don't use these directly.
-    void setLine(size_t lineNo) { m_line = lineNo; }
-    void setPos(size_t posNo)   { m_pos = posNo; }
-    void setFileIndex(size_t i) { m_fileIndex = i; }
+    /// For values read from a file, the line it came from (0 if unknown).
+    /// Worked out from the offset when asked for, so not free.
+    size_t      line() const;
+    /// For values read from a file, the position within the line it came
+    /// from (0 if unknown).  Worked out from the offset when asked for.
+    size_t      pos()  const;
+    /// For values read from a file, the byte offset into the file it came
+    /// from (kNoOffset if unknown).
+    size_t      offset() const { return m_offset; }
+
+    // For the parser: set offset/file.  Don't use these directly.
+    void setOffset(size_t offset) { m_offset = offset; }
+    void setFileIndex(size_t i)   { m_fileIndex = i; }
 
     /// Does the value have source file information (did it come from parsing a file)?
     bool hasSourceInfo() const { return m_fileIndex != kNotFromFile; }
@@ -355,10 +369,14 @@ public:
     //
 
     /// Number of values inside this value (for arrays and blocks)
-    size_t size() const { return (m_type == kTypeArray || m_type == kTypeBlock) ? m_values.size() : 0; }
+    size_t size() const
+    {
+        loadDeferred();
+        return (m_type == kTypeArray || m_type == kTypeBlock) ? m_values.size() : 0;
+    }
 
     // Raw values access; only use this if you know what you are doing
-    const ValueArray& values() const { return m_values; }
+    const ValueArray& values() const { loadDeferred(); return m_values; }
 
 
     // Array access / management
@@ -430,6 +448,10 @@ public:
                      Value::Ptr pValue);
     /// Append a value by name.  Note: does not work on arrays.
     void appendValue(const std::string& name, Value::Ptr pValue);
+    /// Append values by name, in order, as appendValue would one at a time,
+    /// but without searching the block for each name.  Note: does not work on
+    /// arrays.
+    void appendValues(const std::vector<std::string>& names, const ValueArray& values);
 
     /// List value names in a block.  Note: is empty for arrays and other values.
     const std::vector<std::string>& names() const { return m_blockValueNames; }
@@ -452,14 +474,14 @@ public:
     /// Find a value by parsing and following a reference, throws \ref ParseException if parsing fails.
     Value::ConstPtr find(const std::string& refString) const
     {
-        Reference::Ptr pRef = Reference::fromString(refString);
+        Reference::ConstPtr pRef = Reference::fromStringCached(refString);
         return find(*pRef);
     }
 
     /// Find a value by parsing and following a reference, throws \ref ParseException if parsing fails.
     Value::Ptr find(const std::string& refString)
     {
-        Reference::Ptr pRef = Reference::fromString(refString);
+        Reference::ConstPtr pRef = Reference::fromStringCached(refString);
         return find(*pRef);
     }
 
@@ -485,6 +507,21 @@ public:
                             bool keepInline = false,
                             size_t indentation = 0) const;
 
+    /// \brief Serialize this node's data straight into a stream.
+    ///
+    /// Produces the same text as \ref str, but walks the tree once, writing
+    /// every nested value directly to the stream instead of building and
+    /// copying a string per nesting level.  Formatting flags set on the stream
+    /// do not affect the output.
+    /// @param stream         The stream to write to.
+    /// @param followIncludes Optional, whether includes should be replaced by the contents of each include file.
+    /// @param keepInline     Optional, whether to keep all output on one line.
+    /// @param indentation    Optional, how far to indent the written data, useful for indicating nesting (internally, 4 spaces are used for each recursive indentation level).
+    virtual void serialize(std::ostream& stream,
+                           bool followIncludes = false,
+                           bool keepInline = false,
+                           size_t indentation = 0) const;
+
 
 protected:
     typedef std::map<std::string, Value::Ptr> ValueMap;
@@ -499,6 +536,32 @@ protected:
     /// Map a file index to a filename, if available
     virtual std::string file(FileIndex index) const { return m_pContext != NULL ? m_pContext->file(index) : ""; }
 
+    /// Map an offset into a file to a line (from 1) and column (from 0), if
+    /// the file's lines are known
+    virtual bool locate(FileIndex index, size_t offset, size_t& outLine, size_t& outColumn) const
+    {
+        return m_pContext != NULL && m_pContext->locate(index, offset, outLine, outColumn);
+    }
+
+    /// Load any contents whose loading was put off until they are first
+    /// searched (see LoadOptions::m_lazyIncludes).  Only values with
+    /// m_hasDeferred set have any, so the rest just test the flag.
+    void loadDeferred() const
+    {
+        if (m_hasDeferred.load(std::memory_order_acquire))
+        {
+            loadDeferredValues();
+        }
+    }
+    /// Do the loading for loadDeferred(); plain values never have any
+    virtual void loadDeferredValues() const { }
+
+
+    /// Write a name and " = " for a block member, quoting the name if needed
+    static void serializeName(std::ostream& stream, const std::string& name);
+    /// Write indentation spaces
+    static void serializeIndentation(std::ostream& stream, size_t indentation);
+
 
     static const Value::ConstPtr m_spNull; // Predefined null value
 
@@ -507,8 +570,10 @@ protected:
     Value::Ptr m_pInheritedBlock;
     Type m_type;
     TypeName m_typeName;
-    size_t m_line, m_pos;
+    size_t m_offset;
     FileIndex m_fileIndex;
+    /// Set while loadDeferred() still has contents to load
+    mutable std::atomic<bool> m_hasDeferred;
 
     // The value will fill out the following discriminated based on m_type
     ValueArray m_values;
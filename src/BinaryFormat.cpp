@@ -0,0 +1,568 @@
+////////////
+//
+//  File:      BinaryFormat.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Compact binary (.rsdb) encoding of parsed RSD data
+//
+////////////
+
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+#include <Rsd/Macro.h>
+#include <Rsd/Parser.h>
+#include <Rsd/Reference.h>
+
+#include "BinaryFormat.h"
+#include "LineIndex.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+        namespace BinaryFormat
+        {
+
+
+namespace
+{
+
+const char kMagic[8] = { '\x89', 'R', 'S', 'D', 'B', '\r', '\n', '\x1a' };
+
+const unsigned char kTypeMask      = 0x0f;
+const unsigned char kFlagTypeName  = 0x10;
+const unsigned char kFlagInherits  = 0x20;
+
+/// Deepest nesting we will decode, to keep corrupt data from blowing the stack
+const unsigned int kMaxDepth = 10000;
+
+
+//
+// Writing
+//
+
+class Writer
+{
+public:
+    Writer(const LineIndex* pLines)
+        : m_body(), m_pLines(pLines), m_strings(), m_stringIds(), m_types(), m_typeIds()
+    {
+        // Type 0 is always the empty type name
+        m_types.push_back(TypeName());
+        m_typeIds[TypeName()] = 0;
+    }
+
+    void blockBody(const std::vector<std::string>& names, const ValueArray& values)
+    {
+        putVarint(values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            putVarint(stringId(i < names.size() ? names[i] : std::string()));
+            value(*values[i]);
+        }
+    }
+
+    void value(const Value& v)
+    {
+        if (v.isInclude())
+        {
+            // Whatever was loaded for an include, only the statement is kept
+            putByte(static_cast<unsigned char>(Value::kTypeInvalid) | kFlagTypeName);
+            offset(v);
+            putVarint(typeId(v.typeName()));
+            return;
+        }
+
+        unsigned char tag = static_cast<unsigned char>(v.type());
+        if (v.hasTypeName())
+            tag |= kFlagTypeName;
+        if (v.type() == Value::kTypeBlock && v.inheritsBlock())
+            tag |= kFlagInherits;
+        putByte(tag);
+        offset(v);
+        if (v.hasTypeName())
+            putVarint(typeId(v.typeName()));
+
+        switch (v.type())
+        {
+        case Value::kTypeBoolean:
+            putByte(v.asBoolean() ? 1 : 0);
+            break;
+        case Value::kTypeInteger:
+        {
+            long long i = v.asInteger();
+            putVarint((static_cast<unsigned long long>(i) << 1) ^ static_cast<unsigned long long>(i >> 63));
+            break;
+        }
+        case Value::kTypeFloat:
+        {
+            double f = v.asFloat();
+            unsigned long long bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            for (size_t i = 0; i < 8; ++i)
+            {
+                putByte(static_cast<unsigned char>(bits >> (8 * i)));
+            }
+            break;
+        }
+        case Value::kTypeString:
+            putVarint(stringId(v.asRawString()));
+            break;
+        case Value::kTypeReference:
+        {
+            const Reference::PartsList& parts = v.asRawReference()->parts();
+            putVarint(parts.size());
+            for (Reference::PartsList::const_iterator iter = parts.begin();
+                 iter != parts.end();
+                 ++iter)
+            {
+                if (Reference::getPartType(*iter) == Reference::kPartIdentifier)
+                {
+                    putByte(0);
+                    putVarint(stringId(iter->m_identifier));
+                }
+                else
+                {
+                    putByte(1);
+                    value(*iter->m_pSubscriptValue);
+                }
+            }
+            break;
+        }
+        case Value::kTypeMacro:
+        {
+            MacroInvocation::ConstPtr pMacro = v.asRawMacro();
+            putVarint(stringId(pMacro->name()));
+            putVarint(pMacro->arguments().size());
+            for (MacroInvocation::ArgumentValueMap::const_iterator iter = pMacro->arguments().begin();
+                 iter != pMacro->arguments().end();
+                 ++iter)
+            {
+                putVarint(stringId(iter->first));
+                value(*iter->second);
+            }
+            break;
+        }
+        case Value::kTypeArray:
+            putVarint(v.values().size());
+            for (size_t i = 0; i < v.values().size(); ++i)
+            {
+                value(*v.values()[i]);
+            }
+            break;
+        case Value::kTypeBlock:
+            if (v.inheritsBlock())
+            {
+                value(*v.inheritedBlock());
+            }
+            blockBody(v.names(), v.values());
+            break;
+        default:
+            break;
+        }
+    }
+
+    /// Put it all together: header, tables, then the encoded values
+    void finish(std::ostream& stream)
+    {
+        std::string body;
+        body.swap(m_body);
+
+        m_body.assign(kMagic, sizeof(kMagic));
+        putVarint(kVersion);
+
+        putVarint(m_strings.size());
+        for (size_t i = 0; i < m_strings.size(); ++i)
+        {
+            putVarint(m_strings[i]->length());
+            m_body += *m_strings[i];
+        }
+
+        // Type name parts were interned when each type was first seen, so
+        // this adds no strings after the string table is out
+        putVarint(m_types.size());
+        for (size_t i = 0; i < m_types.size(); ++i)
+        {
+            putVarint(m_types[i].size());
+            for (size_t j = 0; j < m_types[i].size(); ++j)
+            {
+                putVarint(stringId(m_types[i][j]));
+            }
+        }
+
+        // Line starts after the first (always 0), as the distance from the
+        // previous one
+        if (m_pLines)
+        {
+            const LineIndex::LineStarts& lineStarts = m_pLines->lineStarts();
+            putVarint(m_pLines->length());
+            putVarint(lineStarts.size() - 1);
+            for (size_t i = 1; i < lineStarts.size(); ++i)
+            {
+                putVarint(lineStarts[i] - lineStarts[i - 1]);
+            }
+        }
+        else
+        {
+            putVarint(0);
+            putVarint(0);
+        }
+
+        stream.write(m_body.data(), static_cast<std::streamsize>(m_body.size()));
+        stream.write(body.data(), static_cast<std::streamsize>(body.size()));
+    }
+
+private:
+    void putByte(unsigned char c)
+    {
+        m_body += static_cast<char>(c);
+    }
+
+    /// Offsets are stored one higher, so that 0 can mean there is none
+    void offset(const Value& v)
+    {
+        putVarint(v.offset() == kNoOffset ? 0 : static_cast<unsigned long long>(v.offset()) + 1);
+    }
+
+    void putVarint(unsigned long long v)
+    {
+        while (v >= 0x80)
+        {
+            m_body += static_cast<char>((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        m_body += static_cast<char>(v);
+    }
+
+    size_t stringId(const std::string& s)
+    {
+        std::unordered_map<std::string, size_t>::iterator found = m_stringIds.find(s);
+        if (found != m_stringIds.end())
+            return found->second;
+        size_t id = m_strings.size();
+        found = m_stringIds.insert(std::make_pair(s, id)).first;
+        m_strings.push_back(&found->first);
+        return id;
+    }
+
+    size_t typeId(const TypeName& t)
+    {
+        std::map<TypeName, size_t>::iterator found = m_typeIds.find(t);
+        if (found != m_typeIds.end())
+            return found->second;
+        for (size_t i = 0; i < t.size(); ++i)
+        {
+            stringId(t[i]);
+        }
+        size_t id = m_types.size();
+        m_types.push_back(t);
+        m_typeIds[t] = id;
+        return id;
+    }
+
+    std::string m_body;
+    const LineIndex* m_pLines;
+    /// Interned strings in id order (pointing at the keys of m_stringIds)
+    std::vector<const std::string*> m_strings;
+    std::unordered_map<std::string, size_t> m_stringIds;
+    std::vector<TypeName> m_types;
+    std::map<TypeName, size_t> m_typeIds;
+};
+
+
+//
+// Reading
+//
+
+class Reader
+{
+public:
+    Reader(const char* data, size_t length, const std::string& sourceName)
+        : m_pData(reinterpret_cast<const unsigned char*>(data)),
+          m_pEnd(reinterpret_cast<const unsigned char*>(data) + length),
+          m_sourceName(sourceName), m_strings(), m_types() { }
+
+    void read(std::vector<std::string>& outNames, ValueArray& outValues, LineIndex& outLines)
+    {
+        if (!isBinary(reinterpret_cast<const char*>(m_pData), m_pEnd - m_pData))
+            fail("missing header");
+        m_pData += sizeof(kMagic);
+        if (varint() != kVersion)
+            fail("unsupported version");
+
+        size_t numStrings = count();
+        m_strings.resize(numStrings);
+        for (size_t i = 0; i < numStrings; ++i)
+        {
+            size_t length = count();
+            m_strings[i].assign(reinterpret_cast<const char*>(m_pData), length);
+            m_pData += length;
+        }
+
+        size_t numTypes = count();
+        m_types.resize(numTypes);
+        for (size_t i = 0; i < numTypes; ++i)
+        {
+            size_t numParts = count();
+            m_types[i].reserve(numParts);
+            for (size_t j = 0; j < numParts; ++j)
+            {
+                m_types[i].push_back(string());
+            }
+        }
+
+        size_t textLength = static_cast<size_t>(varint());
+        size_t numLineStarts = count();
+        LineIndex::LineStarts lineStarts(1, 0);
+        lineStarts.reserve(numLineStarts + 1);
+        for (size_t i = 0; i < numLineStarts; ++i)
+        {
+            unsigned long long distance = varint();
+            if (distance == 0 || distance > textLength - lineStarts.back())
+                fail("bad line start");
+            lineStarts.push_back(lineStarts.back() + static_cast<size_t>(distance));
+        }
+        outLines.assign(lineStarts, textLength);
+
+        blockBody(outNames, outValues, 0);
+        if (m_pData != m_pEnd)
+            fail("trailing data");
+    }
+
+private:
+    void fail(const char* what)
+    {
+        throw Parser::ParseException(std::string("Corrupt binary RSD data: ") + what,
+                                     m_sourceName, 0, 0);
+    }
+
+    unsigned char byte()
+    {
+        if (m_pData >= m_pEnd)
+            fail("unexpected end of data");
+        return *m_pData++;
+    }
+
+    unsigned long long varint()
+    {
+        unsigned long long result = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7)
+        {
+            unsigned char c = byte();
+            result |= static_cast<unsigned long long>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return result;
+        }
+        fail("bad varint");
+        return 0;
+    }
+
+    /// A count or length; every counted item takes at least a byte, so it
+    /// can't be bigger than what is left
+    size_t count()
+    {
+        unsigned long long n = varint();
+        if (n > static_cast<unsigned long long>(m_pEnd - m_pData))
+            fail("bad count");
+        return static_cast<size_t>(n);
+    }
+
+    const std::string& string()
+    {
+        unsigned long long id = varint();
+        if (id >= m_strings.size())
+            fail("bad string id");
+        return m_strings[id];
+    }
+
+    void blockBody(std::vector<std::string>& outNames, ValueArray& outValues, unsigned int depth)
+    {
+        size_t numValues = count();
+        outNames.reserve(numValues);
+        outValues.reserve(numValues);
+        for (size_t i = 0; i < numValues; ++i)
+        {
+            outNames.push_back(string());
+            outValues.push_back(value(depth + 1));
+        }
+    }
+
+    Value::Ptr value(unsigned int depth)
+    {
+        if (depth > kMaxDepth)
+            fail("nesting too deep");
+
+        unsigned char tag = byte();
+        unsigned long long offsetPlusOne = varint();
+        const TypeName* pTypeName = NULL;
+        if (tag & kFlagTypeName)
+        {
+            unsigned long long id = varint();
+            if (id >= m_types.size())
+                fail("bad type id");
+            pTypeName = &m_types[id];
+        }
+
+        Value::Ptr pValue;
+        switch (static_cast<Value::Type>(tag & kTypeMask))
+        {
+        case Value::kTypeInvalid:
+            pValue = new Value();
+            break;
+        case Value::kTypeBoolean:
+            pValue = new Value(byte() != 0);
+            break;
+        case Value::kTypeInteger:
+        {
+            unsigned long long zigzag = varint();
+            long long i = static_cast<long long>(zigzag >> 1) ^ -static_cast<long long>(zigzag & 1);
+            pValue = new Value(static_cast<long>(i));
+            break;
+        }
+        case Value::kTypeFloat:
+        {
+            if (m_pEnd - m_pData < 8)
+                fail("unexpected end of data");
+            unsigned long long bits = 0;
+            for (size_t i = 0; i < 8; ++i)
+            {
+                bits |= static_cast<unsigned long long>(m_pData[i]) << (8 * i);
+            }
+            m_pData += 8;
+            double f;
+            std::memcpy(&f, &bits, sizeof(f));
+            pValue = new Value(f);
+            break;
+        }
+        case Value::kTypeString:
+            pValue = new Value(string());
+            break;
+        case Value::kTypeReference:
+            pValue = new Value(reference(depth));
+            break;
+        case Value::kTypeMacro:
+        {
+            MacroInvocation::Ptr pMacro = new MacroInvocation();
+            pMacro->setName(string());
+            size_t numArguments = count();
+            for (size_t i = 0; i < numArguments; ++i)
+            {
+                const std::string& name = string();
+                pMacro->arguments().insert(std::make_pair(name, value(depth + 1)));
+            }
+            pValue = new Value(pMacro);
+            break;
+        }
+        case Value::kTypeArray:
+        {
+            size_t numValues = count();
+            ValueArray values;
+            values.reserve(numValues);
+            for (size_t i = 0; i < numValues; ++i)
+            {
+                values.push_back(value(depth + 1));
+            }
+            pValue = new Value(values);
+            break;
+        }
+        case Value::kTypeBlock:
+        {
+            Value::Ptr pInherited;
+            if (tag & kFlagInherits)
+            {
+                pInherited = value(depth + 1);
+            }
+            std::vector<std::string> names;
+            ValueArray values;
+            blockBody(names, values, depth);
+            pValue = new Value(names, values);
+            if (pInherited)
+            {
+                pValue->setInheritedBlock(pInherited);
+            }
+            break;
+        }
+        default:
+            fail("bad value tag");
+        }
+
+        pValue->setOffset(offsetPlusOne == 0 ? kNoOffset : static_cast<size_t>(offsetPlusOne - 1));
+        if (pTypeName)
+        {
+            pValue->setTypeName(*pTypeName);
+        }
+        return pValue;
+    }
+
+    Reference::Ptr reference(unsigned int depth)
+    {
+        Reference::Ptr pRef = new Reference();
+        size_t numParts = count();
+        for (size_t i = 0; i < numParts; ++i)
+        {
+            Reference::Part part;
+            if (byte() == 0)
+            {
+                part.m_identifier = string();
+            }
+            else
+            {
+                part.m_pSubscriptValue = value(depth + 1);
+            }
+            pRef->parts().push_back(part);
+        }
+        return pRef;
+    }
+
+    const unsigned char* m_pData;
+    const unsigned char* m_pEnd;
+    const std::string& m_sourceName;
+    std::vector<std::string> m_strings;
+    std::vector<TypeName> m_types;
+};
+
+}
+
+
+bool isBinary(const char* data, size_t length)
+{
+    return length >= sizeof(kMagic) && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+
+bool mayBeBinary(std::istream& stream)
+{
+    return stream.peek() == static_cast<unsigned char>(kMagic[0]);
+}
+
+
+void write(std::ostream& stream,
+           const std::vector<std::string>& names,
+           const ValueArray& values,
+           const LineIndex* pLines)
+{
+    Writer writer(pLines);
+    writer.blockBody(names, values);
+    writer.finish(stream);
+}
+
+
+void read(const char* data,
+          size_t length,
+          const std::string& sourceName,
+          std::vector<std::string>& outNames,
+          ValueArray& outValues,
+          LineIndex& outLines)
+{
+    Reader reader(data, length, sourceName);
+    reader.read(outNames, outValues, outLines);
+}
+
+
+        } // namespace BinaryFormat
+    } // namespace Rsd
+} // namespace RenderSpud
@@ -0,0 +1,107 @@
+////////////
+//
+//  File:      BinaryFormat.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Compact binary (.rsdb) encoding of parsed RSD data
+//
+////////////
+
+#ifndef __RSD_BinaryFormat_h__
+#define __RSD_BinaryFormat_h__
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <Rsd/Value.h>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+class LineIndex;
+
+
+        namespace BinaryFormat
+        {
+
+
+/*
+
+Binary RSD (.rsdb) layout.  All integers are LEB128 varints unless noted;
+signed integers are zigzag-encoded first.
+
+file        ::= magic version string-table type-table line-table block-body
+magic       ::= 0x89 'R' 'S' 'D' 'B' '\r' '\n' 0x1a
+version     ::= varint
+string-table ::= count { length bytes }
+type-table  ::= count { part-count { string-id } }   (entry 0 is the empty type)
+line-table  ::= text-length count { distance }        (line starts after the first)
+block-body  ::= count { name-string-id value }
+value       ::= tag offset [ type-id ] payload
+
+offset is the value's byte offset into the text it was parsed from, plus one
+(0 if it has none); with the line table it gives the value's line and pos.
+
+tag is the Value::Type in the low nibble, plus kFlagTypeName if a type-id
+follows and kFlagInherits if a block has an inherited-block reference.  The
+payloads are:
+
+  invalid   (nothing; with type "include" this is an include statement,
+             whose name in the enclosing block is the path)
+  boolean   one byte
+  integer   zigzag varint
+  float     8 bytes, IEEE double, little-endian
+  string    string-id
+  reference part-count { 0 string-id | 1 value }   (identifier or subscript)
+  macro     name-string-id count { name-string-id value }
+  array     count { value }
+  block     [ value (the inherited-block reference) ] block-body
+
+*/
+
+
+/// Current version written by \ref write
+const unsigned int kVersion = 2;
+
+
+/// Does the data start with the binary format's magic?
+bool isBinary(const char* data, size_t length);
+
+/// Might the stream hold binary data?  Only peeks at its first byte, which
+/// starts the magic and never starts text.
+bool mayBeBinary(std::istream& stream);
+
+/// Write the members of a block in the binary format.  Include statements
+/// (and include files that were opened) are written as include statements.
+/// The line starts of the text the values were parsed from, if given, are
+/// kept so they still have lines and positions when read back.
+void write(std::ostream& stream,
+           const std::vector<std::string>& names,
+           const ValueArray& values,
+           const LineIndex* pLines);
+
+/// Decode binary data into the members of a block, and the line starts of
+/// the text they were parsed from.  Contexts are left for the caller to fix
+/// up.  Throws \ref Parser::ParseException (against sourceName) if the data
+/// is corrupt or of an unknown version.
+void read(const char* data,
+          size_t length,
+          const std::string& sourceName,
+          std::vector<std::string>& outNames,
+          ValueArray& outValues,
+          LineIndex& outLines);
+
+
+        } // namespace BinaryFormat
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_BinaryFormat_h__
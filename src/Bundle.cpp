@@ -0,0 +1,292 @@
+////////////
+//
+//  File:      Bundle.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Single-file archive (.rsda) of a scene and all its includes
+//
+////////////
+
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <vector>
+
+#include <Rsd/File.h>
+#include <Rsd/Parser.h>
+
+#include "Bundle.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+namespace
+{
+
+const char kMagic[8] = { '\x89', 'R', 'S', 'D', 'A', '\r', '\n', '\x1a' };
+
+
+/// Directory part of a path, "." if it has none
+std::string directoryOf(const std::string& path)
+{
+    size_t lastSlash = path.rfind('/');
+    if (lastSlash == std::string::npos)
+    {
+        return ".";
+    }
+    return path.substr(0, lastSlash);
+}
+
+
+/// Names of the include statements under v, in order
+void findIncludeNames(const Value& v, std::vector<std::string>& outNames)
+{
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        if (v.values()[i]->isInclude())
+        {
+            outNames.push_back(v.names()[i]);
+        }
+        else
+        {
+            findIncludeNames(*v.values()[i], outNames);
+        }
+    }
+}
+
+
+void putInteger(std::ostream& stream, unsigned long long i)
+{
+    char bytes[8];
+    for (size_t b = 0; b < 8; ++b)
+    {
+        bytes[b] = static_cast<char>(i >> (8 * b));
+    }
+    stream.write(bytes, sizeof(bytes));
+}
+
+
+/// Reads the bundle index, throwing ParseExceptions on corrupt data
+class IndexReader
+{
+public:
+    IndexReader(const char* data, size_t length, const std::string& sourceName)
+        : m_pData(data), m_pEnd(data + length), m_sourceName(sourceName) { }
+
+    unsigned long long integer()
+    {
+        if (m_pEnd - m_pData < 8)
+            fail("unexpected end of index");
+        unsigned long long i = 0;
+        for (size_t b = 0; b < 8; ++b)
+        {
+            i |= static_cast<unsigned long long>(static_cast<unsigned char>(m_pData[b])) << (8 * b);
+        }
+        m_pData += 8;
+        return i;
+    }
+
+    std::string path()
+    {
+        unsigned long long length = integer();
+        if (length > static_cast<unsigned long long>(m_pEnd - m_pData))
+            fail("path runs past the end of the data");
+        std::string p(m_pData, static_cast<size_t>(length));
+        m_pData += length;
+        return p;
+    }
+
+    void fail(const char* what)
+    {
+        throw Parser::ParseException(std::string("Corrupt RSD bundle: ") + what,
+                                     m_sourceName, 0, 0);
+    }
+
+private:
+    const char* m_pData;
+    const char* m_pEnd;
+    std::string m_sourceName;
+};
+
+}
+
+
+bool Bundle::isBundle(const char* data, size_t length)
+{
+    return length >= sizeof(kMagic) && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+
+bool Bundle::isBundleFile(const std::string& filename)
+{
+    std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+    char magic[sizeof(kMagic)];
+    if (!stream.read(magic, sizeof(magic)))
+    {
+        return false;
+    }
+    return isBundle(magic, sizeof(magic));
+}
+
+
+std::string Bundle::normalizePath(const std::string& path)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.length())
+    {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+        {
+            end = path.length();
+        }
+        std::string part = path.substr(start, end - start);
+        start = end + 1;
+
+        if (part.empty() || part == ".")
+        {
+            continue;
+        }
+        if (part == ".." && !parts.empty() && parts.back() != "..")
+        {
+            parts.pop_back();
+            continue;
+        }
+        parts.push_back(part);
+    }
+
+    std::string normalized = (!path.empty() && path[0] == '/') ? "/" : "";
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        if (i > 0)
+        {
+            normalized += '/';
+        }
+        normalized += parts[i];
+    }
+    if (normalized.empty())
+    {
+        normalized = ".";
+    }
+    return normalized;
+}
+
+
+void Bundle::pack(const std::string& rootFilename, std::ostream& stream)
+{
+    // Gather the files breadth-first, following each file's includes from
+    // its directory, just as loading would
+    const std::string rootDirectory = directoryOf(rootFilename);
+    std::vector<std::string> paths;
+    std::vector<std::string> contents;
+    std::set<std::string> seen;
+    paths.push_back(normalizePath(rootFilename.substr(rootFilename.rfind('/') + 1)));
+    seen.insert(paths.back());
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        std::string filename = rootDirectory + "/" + paths[i];
+        MappedFile input(filename);
+        if (!input.isOpen())
+        {
+            throw FileIOException(filename, "opened");
+        }
+        contents.push_back(std::string(input.data(), input.size()));
+
+        File::FilePtr pFile = new File(contents.back(), filename, ".", LoadOptions(false));
+        std::vector<std::string> includeNames;
+        findIncludeNames(*pFile, includeNames);
+        for (size_t j = 0; j < includeNames.size(); ++j)
+        {
+            std::string includePath = normalizePath(directoryOf(paths[i]) + "/" + includeNames[j]);
+            if (seen.insert(includePath).second)
+            {
+                paths.push_back(includePath);
+            }
+        }
+    }
+
+    size_t indexSize = sizeof(kMagic) + 2 * 8;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        indexSize += 3 * 8 + paths[i].length();
+    }
+
+    stream.write(kMagic, sizeof(kMagic));
+    putInteger(stream, kVersion);
+    putInteger(stream, paths.size());
+    size_t offset = indexSize;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        putInteger(stream, paths[i].length());
+        stream.write(paths[i].data(), static_cast<std::streamsize>(paths[i].length()));
+        putInteger(stream, offset);
+        putInteger(stream, contents[i].length());
+        offset += contents[i].length();
+    }
+    for (size_t i = 0; i < contents.size(); ++i)
+    {
+        stream.write(contents[i].data(), static_cast<std::streamsize>(contents[i].length()));
+    }
+}
+
+
+Bundle::Bundle(const std::string& filename)
+    : m_file(), m_rootPath(), m_entries()
+{
+    if (!m_file.open(filename))
+    {
+        throw FileIOException(filename, "opened");
+    }
+    if (!isBundle(m_file.data(), m_file.size()))
+    {
+        throw Parser::ParseException("Not an RSD bundle", filename, 0, 0);
+    }
+
+    IndexReader reader(m_file.data() + sizeof(kMagic), m_file.size() - sizeof(kMagic), filename);
+    if (reader.integer() != kVersion)
+    {
+        reader.fail("unknown version");
+    }
+    unsigned long long count = reader.integer();
+    if (count == 0)
+    {
+        reader.fail("no root file");
+    }
+    for (unsigned long long i = 0; i < count; ++i)
+    {
+        std::string path = reader.path();
+        unsigned long long offset = reader.integer();
+        unsigned long long size = reader.integer();
+        if (offset > m_file.size() || size > m_file.size() - offset)
+        {
+            reader.fail("file data runs past the end of the bundle");
+        }
+        if (i == 0)
+        {
+            m_rootPath = path;
+        }
+        m_entries[path] = std::make_pair(static_cast<size_t>(offset), static_cast<size_t>(size));
+    }
+}
+
+
+bool Bundle::find(const std::string& path, const char*& outData, size_t& outSize) const
+{
+    EntryMap::const_iterator found = m_entries.find(normalizePath(path));
+    if (found == m_entries.end())
+    {
+        return false;
+    }
+    outData = m_file.data() + found->second.first;
+    outSize = found->second.second;
+    return true;
+}
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
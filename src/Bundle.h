@@ -0,0 +1,98 @@
+////////////
+//
+//  File:      Bundle.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Single-file archive (.rsda) of a scene and all its includes
+//
+////////////
+
+#ifndef __RSD_Bundle_h__
+#define __RSD_Bundle_h__
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "MappedFile.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+/*
+
+Bundle (.rsda) layout.  All integers are 64-bit little-endian.
+
+bundle      ::= magic version count { entry } data
+magic       ::= 0x89 'R' 'S' 'D' 'A' '\r' '\n' 0x1a
+entry       ::= path-length path offset size
+data        ::= the bytes of every file, where each entry's offset (from the
+                start of the bundle) and size say
+
+Entry 0 is the root file.  Paths are relative to the root file's directory,
+with "." and ".." collapsed as far as they go, and are how includes are
+looked up: an include's path is its includer's directory plus the name in
+the include statement, collapsed the same way.  Files are stored exactly as
+they were on disk, text or binary.
+
+*/
+
+
+/// A packed scene, read from a single mapping of the bundle file
+class Bundle
+{
+public:
+    /// Current version written by \ref pack
+    static const unsigned long long kVersion = 1;
+
+    /// Does the data start with the bundle magic?
+    static bool isBundle(const char* data, size_t length);
+    /// Does the file start with the bundle magic?
+    static bool isBundleFile(const std::string& filename);
+
+    /// Collapse "." and ".." (where possible) and repeated slashes out of a
+    /// path, giving the form bundle paths are stored in
+    static std::string normalizePath(const std::string& path);
+
+    /// Write a bundle holding a file and every file it transitively
+    /// includes.  Throws FileIOException if a file could not be read, or
+    /// Parser::ParseException if one could not be parsed to find its
+    /// includes.
+    static void pack(const std::string& rootFilename, std::ostream& stream);
+
+    /// Map a bundle file.  Throws FileIOException if it could not be opened,
+    /// or Parser::ParseException if it is not a valid bundle.
+    explicit Bundle(const std::string& filename);
+
+    /// Path of the root file within the bundle
+    const std::string& rootPath() const { return m_rootPath; }
+
+    /// Get the contents of a file in the bundle (the path is normalized
+    /// first); false if the bundle does not hold it
+    bool find(const std::string& path, const char*& outData, size_t& outSize) const;
+
+private:
+    // Forbidden
+    Bundle(const Bundle&);
+    Bundle& operator =(const Bundle&);
+
+    typedef std::unordered_map<std::string, std::pair<size_t, size_t> > EntryMap;
+
+    MappedFile m_file;
+    std::string m_rootPath;
+    /// Offset and size of each file, by path
+    EntryMap m_entries;
+};
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_Bundle_h__
@@ -13,10 +13,26 @@
 #include <sstream>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <Rsd/File.h>
+#include <Rsd/IncludeCache.h>
 #include <Rsd/Parser.h>
 
+#include "BinaryFormat.h"
+#include "Bundle.h"
+#include "LineIndex.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
 
 namespace RenderSpud
 {
@@ -24,35 +40,324 @@ namespace RenderSpud
     {
 
 
+namespace
+{
+
+/// Size of the output buffer used when writing files
+const size_t kWriteBufferSize = 256 * 1024;
+
+
+/// Directory portion of an include's path, which its own includes are
+/// relative to
+std::string includePathBaseOf(const std::string& filename)
+{
+    size_t lastSlash = filename.rfind('/');
+    if (lastSlash != std::string::npos)
+    {
+        return filename.substr(0, lastSlash);
+    }
+    return std::string();
+}
+
+
+/// Throw if the load these options belong to was cancelled
+void checkCancelled(const LoadOptions& options)
+{
+    if (options.m_pCancel && options.m_pCancel->load(std::memory_order_relaxed))
+    {
+        throw LoadCancelledException();
+    }
+}
+
+
+/// Options for loading a file again later (lazily or on reload), which the
+/// original load's cancellation no longer applies to
+LoadOptions laterLoadOptions(const LoadOptions& options)
+{
+    LoadOptions laterOptions = options;
+    laterOptions.m_pCancel.reset();
+    return laterOptions;
+}
+
+
+/// Top-level values each thread should have at least, for fixing them up to
+/// be worth spreading over threads
+const size_t kMinValuesPerThread = 1024;
+
+
+/// Threads to fix up the top-level values of a parsed file on
+size_t fixupThreads(const LoadOptions& options, size_t numValues)
+{
+    return std::min(options.m_parseThreads, numValues / kMinValuesPerThread);
+}
+
+
+/// Run task(begin, end) over ranges of numValues values on numThreads
+/// threads, a few ranges per thread to even out the work
+void forValueRanges(size_t numThreads,
+                    size_t numValues,
+                    const std::function<void(size_t, size_t)>& task)
+{
+    size_t numRanges = numThreads * 4;
+    runInParallel(numThreads, numRanges, [&](size_t r)
+    {
+        task(numValues * r / numRanges, numValues * (r + 1) / numRanges);
+    });
+}
+
+
+/// Set the file index of a value and everything in it, giving false (and
+/// stopping) on finding an include, which File::processValue has to see to
+bool setFileIndexUnlessIncludes(Value& v, size_t fileIndex)
+{
+    if (v.isInclude())
+    {
+        return false;
+    }
+    v.setFileIndex(fileIndex);
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        if (!setFileIndexUnlessIncludes(*v.values()[i], fileIndex))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/// Threads that File::loadAsync runs loads on
+ThreadPool& asyncLoadPool()
+{
+    // The cache is set up first so it outlives the pool's running loads
+    IncludeCache::instance();
+    static ThreadPool sPool(std::max<unsigned int>(std::thread::hardware_concurrency(), 2));
+    return sPool;
+}
+
+
+/// Get the contents of a bundled file, throwing if the bundle lacks it
+void findInBundle(const Bundle& bundle,
+                  const std::string& filename,
+                  const char*& outData,
+                  size_t& outSize)
+{
+    if (!bundle.find(filename, outData, outSize))
+    {
+        throw FileIOException(filename, "found in the bundle");
+    }
+}
+
+
+/// Gather the loaded include files under v, in order, without looking
+/// inside them
+void findIncludes(const Value& v, std::vector<File::FilePtr>& outIncludes)
+{
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        const Value::Ptr& pChild = v.values()[i];
+        File::FilePtr pInclude = pChild->isInclude() ?
+                                     RenderSpud::dynamic_pointer_cast<File>(pChild) :
+                                     File::FilePtr();
+        if (pInclude)
+        {
+            outIncludes.push_back(pInclude);
+        }
+        else
+        {
+            findIncludes(*pChild, outIncludes);
+        }
+    }
+}
+
+
+/// Copies don't carry the offset they were parsed at; restore those from the
+/// original tree
+void copySourceLocations(const Value& from, Value& to)
+{
+    to.setOffset(from.offset());
+    for (size_t i = 0; i < from.values().size() && i < to.values().size(); ++i)
+    {
+        copySourceLocations(*from.values()[i], *to.values()[i]);
+    }
+}
+
+}
+
+
+//
+// IncludeLoader
+//
+
+/// Reads and parses include files on a thread pool ahead of the serial walk in
+/// File::processValue.  Each include has its own includes scheduled before it
+/// is handed back, so whole include trees load in parallel.  The serial walk
+/// still numbers and attaches every include (and rethrows any load error) in
+/// the usual order.  Loads are keyed by the include statement's placeholder
+/// value, so a file included twice is loaded twice, just as it is serially.
+class IncludeLoader
+{
+public:
+    explicit IncludeLoader(const LoadOptions& options)
+        : m_options(options), m_mutex(), m_loads(), m_pool(options.m_includeThreads) { }
+
+    /// Schedule loads for every include statement found under v
+    void scheduleIncludes(const Value& v, const std::string& pathBase)
+    {
+        for (size_t i = 0; i < v.values().size(); ++i)
+        {
+            const Value& child = *v.values()[i];
+            scheduleIncludes(child, pathBase);
+            if (child.isInclude())
+            {
+                schedule(&child, pathBase + "/" + child.name());
+            }
+        }
+    }
+
+    /// Wait for the include for a placeholder to finish loading, and take it.
+    /// Rethrows whatever its load threw; returns an empty ptr if it was never
+    /// scheduled.
+    File::FilePtr take(const Value* pPlaceholder)
+    {
+        std::shared_future<File::FilePtr> load;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            LoadMap::iterator found = m_loads.find(pPlaceholder);
+            if (found == m_loads.end())
+                return File::FilePtr();
+            load = found->second;
+            m_loads.erase(found);
+        }
+        return load.get();
+    }
+
+private:
+    typedef std::packaged_task<File::FilePtr()> LoadTask;
+    typedef std::map<const Value*, std::shared_future<File::FilePtr> > LoadMap;
+
+    void schedule(const Value* pPlaceholder, const std::string& filename)
+    {
+        std::shared_ptr<LoadTask> pTask =
+            std::make_shared<LoadTask>(std::bind(&IncludeLoader::load, this, filename));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loads[pPlaceholder] = pTask->get_future().share();
+        }
+        m_pool.submit([pTask]() { (*pTask)(); });
+    }
+
+    File::FilePtr load(const std::string& filename)
+    {
+        checkCancelled(m_options);
+        File::FilePtr pInclude = new File();
+        pInclude->recordSource(filename, includePathBaseOf(filename), m_options);
+        pInclude->readFile(filename, m_options);
+        scheduleIncludes(*pInclude, includePathBaseOf(filename));
+        return pInclude;
+    }
+
+    LoadOptions m_options;
+    std::mutex m_mutex;
+    LoadMap m_loads;
+    // Last, so it is shut down before anything its tasks touch goes away
+    ThreadPool m_pool;
+};
+
+
+//
+// File
+//
+
+struct File::DeferredInclude
+{
+    std::string m_filename;
+    std::string m_pathBase;
+    LoadOptions m_options;
+};
+
+
+struct File::SourceFile
+{
+    std::string m_filename;
+    std::string m_pathBase;
+    LoadOptions m_options;
+    long long m_modifiedTime;
+    long long m_size;
+
+    /// Has the file been modified (or gone missing) since it was read?
+    bool changedOnDisk() const
+    {
+        std::string path;
+        long long modifiedTime, fileSize;
+        if (!fileSignature(m_filename, path, modifiedTime, fileSize))
+        {
+            return true;
+        }
+        return modifiedTime != m_modifiedTime || fileSize != m_size;
+    }
+};
+
+
+struct File::ReloadState
+{
+    explicit ReloadState(size_t& numReloaded)
+        : m_includes(), m_numReloaded(numReloaded) { }
+
+    /// Take a previously loaded include of the given file, if there is one
+    /// left, so it is reused rather than opened again
+    FilePtr takeInclude(const std::string& filename)
+    {
+        IncludeMap::iterator found = m_includes.find(filename);
+        if (found == m_includes.end())
+            return FilePtr();
+        FilePtr pInclude = found->second;
+        m_includes.erase(found);
+        return pInclude;
+    }
+
+    /// Includes of the file being reloaded, by filename; a file included
+    /// several times is reused in the same order
+    typedef std::multimap<std::string, FilePtr> IncludeMap;
+    IncludeMap m_includes;
+    size_t& m_numReloaded;
+};
+
+
 File::File()
     : Value(kTypeBlock),
       m_pEnvironment(),
-      m_fileIndexMap()
+      m_fileIndexMap(),
+      m_pDeferredInclude(),
+      m_deferredIncludeMutex(),
+      m_pSource(),
+      m_pLineIndex()
 {
 
 }
 
 
 File::File(const std::string& filename,
-           bool openIncludes)
+           const LoadOptions& options)
     : Value(kTypeBlock),
       m_pEnvironment(),
-      m_fileIndexMap()
+      m_fileIndexMap(),
+      m_pDeferredInclude(),
+      m_deferredIncludeMutex(),
+      m_pSource(),
+      m_pLineIndex()
 {
     m_fileIndexMap.push_back(filename);
 
-    // Read all of the input into a string buffer
-    std::string inputBuffer;
-    std::ifstream inputStream(filename.c_str());
-    if (inputStream.fail())
+    if (!options.m_pBundle && Bundle::isBundleFile(filename))
     {
-        throw FileIOException(filename, "opened");
-    }
-    while (inputStream.good() && !inputStream.eof())
-    {
-        std::string inputLine;
-        getline(inputStream, inputLine);
-        inputBuffer += inputLine + '\n';
+        // Everything comes out of the bundle, starting with its root file;
+        // includes are found relative to that
+        LoadOptions bundleOptions = options;
+        bundleOptions.m_pBundle = std::make_shared<Bundle>(filename);
+        const std::string& rootPath = bundleOptions.m_pBundle->rootPath();
+        openFile(rootPath, m_fileIndexMap, includePathBaseOf("./" + rootPath), bundleOptions);
+        return;
     }
 
     std::string pathBase = "";
@@ -66,56 +371,71 @@ File::File(const std::string& filename,
         pathBase = ".";
     }
 
-    openBuffer(inputBuffer, m_fileIndexMap, pathBase, openIncludes);
+    openFile(filename, m_fileIndexMap, pathBase, options);
 }
 
 
 File::File(std::istream& inputStream,
            const std::string& streamName,
            const std::string& pathBase,
-           bool openIncludes)
+           const LoadOptions& options)
     : Value(kTypeBlock),
       m_pEnvironment(),
-      m_fileIndexMap()
+      m_fileIndexMap(),
+      m_pDeferredInclude(),
+      m_deferredIncludeMutex(),
+      m_pSource(),
+      m_pLineIndex()
 {
     m_fileIndexMap.push_back(streamName);
 
-    // Read all of the input into a string buffer
-    std::string inputBuffer;
-    while (inputStream.good() && !inputStream.eof())
+    // Binary data can't be decoded as it streams in, so it is always read
+    // in whole
+    if (options.m_streamChunkSize > 0 && !BinaryFormat::mayBeBinary(inputStream))
     {
-        std::string inputLine;
-        getline(inputStream, inputLine);
-        inputBuffer += inputLine + '\n';
+        openStream(inputStream, m_fileIndexMap, pathBase, options);
+        return;
     }
 
-    openBuffer(inputBuffer, m_fileIndexMap, pathBase, openIncludes);
+    // Read all of the input into a string buffer, byte for byte
+    std::string inputBuffer((std::istreambuf_iterator<char>(inputStream)),
+                            std::istreambuf_iterator<char>());
+
+    openBuffer(inputBuffer.data(), inputBuffer.length(), m_fileIndexMap, pathBase, options);
 }
 
 
 File::File(const std::string& bufferString,
            const std::string& bufferName,
            const std::string& pathBase,
-           bool openIncludes)
+           const LoadOptions& options)
     : Value(kTypeBlock),
       m_pEnvironment(),
-      m_fileIndexMap()
+      m_fileIndexMap(),
+      m_pDeferredInclude(),
+      m_deferredIncludeMutex(),
+      m_pSource(),
+      m_pLineIndex()
 {
     m_fileIndexMap.push_back(bufferName);
-    openBuffer(bufferString, m_fileIndexMap, pathBase, openIncludes);
+    openBuffer(bufferString.data(), bufferString.length(), m_fileIndexMap, pathBase, options);
 }
 
 
 File::File(const char* buffer,
            const std::string& bufferName,
            const std::string& pathBase,
-           bool openIncludes)
+           const LoadOptions& options)
     : Value(kTypeBlock),
       m_pEnvironment(),
-      m_fileIndexMap()
+      m_fileIndexMap(),
+      m_pDeferredInclude(),
+      m_deferredIncludeMutex(),
+      m_pSource(),
+      m_pLineIndex()
 {
     m_fileIndexMap.push_back(bufferName);
-    openBuffer(buffer, m_fileIndexMap, pathBase, openIncludes);
+    openBuffer(buffer, std::strlen(buffer), m_fileIndexMap, pathBase, options);
 }
 
 
@@ -125,6 +445,33 @@ File::~File()
 }
 
 
+FileLoad File::loadAsync(const std::string& filename,
+                         const LoadOptions& options,
+                         const std::function<void (const FileLoad&)>& onLoaded)
+{
+    LoadOptions loadOptions = options;
+    if (!loadOptions.m_pCancel)
+    {
+        loadOptions.m_pCancel = std::make_shared< std::atomic<bool> >(false);
+    }
+
+    typedef std::packaged_task<FilePtr()> LoadTask;
+    std::shared_ptr<LoadTask> pTask =
+        std::make_shared<LoadTask>([filename, loadOptions]() { return FilePtr(new File(filename, loadOptions)); });
+    FileLoad load(pTask->get_future().share(), loadOptions.m_pCancel);
+
+    asyncLoadPool().submit([pTask, load, onLoaded]()
+    {
+        (*pTask)();
+        if (onLoaded)
+        {
+            onLoaded(load);
+        }
+    });
+    return load;
+}
+
+
 void File::addShellEnvironment()
 {
     if (m_pEnvironment == NULL)
@@ -173,11 +520,8 @@ void File::write(std::ostream& stream,
 {
     if (stream.fail())
         throw FileIOException("output stream", "written");
-    for (size_t i = 0; i < indentation; ++i)
-    {
-        stream << ' ';
-    }
-    stream << this->str(followIncludes, false, indentation);
+    serializeIndentation(stream, indentation);
+    serialize(stream, followIncludes, false, indentation);
     if (stream.fail())
         throw FileIOException("output stream", "written");
 }
@@ -187,50 +531,87 @@ void File::write(const std::string& filename,
                  bool followIncludes,
                  size_t indentation)
 {
-    std::ofstream stream(filename.c_str());
+    // Give the stream a larger buffer than the default, since the serializer
+    // writes lots of small pieces
+    std::vector<char> buffer(kWriteBufferSize);
+    std::ofstream stream;
+    stream.rdbuf()->pubsetbuf(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+    stream.open(filename.c_str());
     if (stream.fail())
         throw FileIOException(filename, "written");
     write(stream, followIncludes, indentation);
+    stream.close();
     if (stream.fail())
         throw FileIOException(filename, "written");
 }
 
 
-std::string File::str(bool followIncludes,
-                      bool keepInline,
-                      size_t indentation) const
+void File::writeBinary(std::ostream& stream) const
+{
+    if (stream.fail())
+        throw FileIOException("output stream", "written");
+    BinaryFormat::write(stream, m_blockValueNames, m_values, m_pLineIndex.get());
+    if (stream.fail())
+        throw FileIOException("output stream", "written");
+}
+
+
+void File::writeBinary(const std::string& filename) const
+{
+    std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
+    if (stream.fail())
+        throw FileIOException(filename, "written");
+    writeBinary(stream);
+    stream.close();
+    if (stream.fail())
+        throw FileIOException(filename, "written");
+}
+
+
+void File::writeBundle(const std::string& rootFilename,
+                       const std::string& bundleFilename)
+{
+    std::vector<char> buffer(kWriteBufferSize);
+    std::ofstream stream;
+    stream.rdbuf()->pubsetbuf(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+    stream.open(bundleFilename.c_str(), std::ios::out | std::ios::binary);
+    if (stream.fail())
+        throw FileIOException(bundleFilename, "written");
+    Bundle::pack(rootFilename, stream);
+    stream.close();
+    if (stream.fail())
+        throw FileIOException(bundleFilename, "written");
+}
+
+
+void File::serialize(std::ostream& stream,
+                     bool followIncludes,
+                     bool keepInline,
+                     size_t indentation) const
 {
     if (isInclude() && !followIncludes)
     {
         // Just spit back the original include statement
-        return std::string("include \"") + this->name() + "\"";
+        stream << "include \"" << this->name() << '"';
+        return;
     }
 
-    std::ostringstream stream;
+    loadDeferred();
 
     for (size_t i = 0; i < m_values.size(); ++i)
     {
         if (!keepInline)
         {
-            for (size_t j = 0; j < indentation; ++j)
-            {
-                stream << ' ';
-            }
+            serializeIndentation(stream, indentation);
         }
         if (!m_values[i]->isInclude())
         {
-            if (Value::isNameStandardFormat(m_blockValueNames[i]))
-            {
-                stream << m_blockValueNames[i] << " = ";
-            }
-            else
-            {
-                stream << '"' << m_blockValueNames[i] << "\" = ";
-            }
+            serializeName(stream, m_blockValueNames[i]);
         }
-        stream << m_values[i]->str(followIncludes,
-                                   keepInline,
-                                   indentation);
+        m_values[i]->serialize(stream,
+                               followIncludes,
+                               keepInline,
+                               indentation);
         if (!m_values[i]->isInclude() || !followIncludes)
         {
             stream << ';';
@@ -248,15 +629,106 @@ std::string File::str(bool followIncludes,
             }
         }
     }
+}
+
 
-    return stream.str();
+void File::openBuffer(const char* input,
+                      size_t length,
+                      FileIndexMap& fileIndexMap,
+                      const std::string& pathBase,
+                      const LoadOptions& options)
+{
+    openInput(input, length, NULL, NULL, fileIndexMap, pathBase, options);
+}
+
+
+void File::openStream(std::istream& inputStream,
+                      FileIndexMap& fileIndexMap,
+                      const std::string& pathBase,
+                      const LoadOptions& options)
+{
+    openInput(NULL, 0, &inputStream, NULL, fileIndexMap, pathBase, options);
 }
 
 
-void File::openBuffer(const std::string& input,
+void File::openParsed(const File& parsed,
                       FileIndexMap& fileIndexMap,
                       const std::string& pathBase,
-                      bool openIncludes)
+                      const LoadOptions& options)
+{
+    openInput(NULL, 0, NULL, &parsed, fileIndexMap, pathBase, options);
+}
+
+
+void File::readFile(const std::string& filename,
+                    const LoadOptions& options)
+{
+    if (options.m_pBundle)
+    {
+        const char* data;
+        size_t size;
+        findInBundle(*options.m_pBundle, filename, data, size);
+        parseInput(data, size, NULL, filename, options);
+        fixupContexts();
+        return;
+    }
+
+    if (options.m_useIncludeCache)
+    {
+        copyParsed(*IncludeCache::instance().acquire(filename));
+        return;
+    }
+
+    MappedFile input(filename);
+    if (!input.isOpen())
+    {
+        throw FileIOException(filename, "opened");
+    }
+    parseInput(input.data(), input.size(), NULL, filename, options);
+    fixupContexts();
+}
+
+
+void File::openFile(const std::string& filename,
+                    FileIndexMap& fileIndexMap,
+                    const std::string& pathBase,
+                    const LoadOptions& options)
+{
+    checkCancelled(options);
+    recordSource(filename, pathBase, options);
+
+    if (options.m_pBundle)
+    {
+        const char* data;
+        size_t size;
+        findInBundle(*options.m_pBundle, filename, data, size);
+        openBuffer(data, size, fileIndexMap, pathBase, options);
+        return;
+    }
+
+    if (options.m_useIncludeCache)
+    {
+        openParsed(*IncludeCache::instance().acquire(filename), fileIndexMap, pathBase, options);
+        return;
+    }
+
+    // Map the file and parse straight out of the mapped pages
+    MappedFile input(filename);
+    if (!input.isOpen())
+    {
+        throw FileIOException(filename, "opened");
+    }
+    openBuffer(input.data(), input.size(), fileIndexMap, pathBase, options);
+}
+
+
+void File::openInput(const char* input,
+                     size_t length,
+                     std::istream* pInputStream,
+                     const File* pParsed,
+                     FileIndexMap& fileIndexMap,
+                     const std::string& pathBase,
+                     const LoadOptions& options)
 {
     try
     {
@@ -266,31 +738,42 @@ void File::openBuffer(const std::string& input,
         // high enough.
         this->incrementReference();
 
-        Parser::Parser parser;
-
         FileIndex currentIndex = fileIndexMap.size() - 1;
 
-        try
+        if (pParsed)
         {
-            parser.parse(input, *this);
+            copyParsed(*pParsed);
         }
-        catch (Parser::ParseException& e)
+        else
         {
-            // Re-throw parser exceptions with the correct source name
-            throw Parser::ParseException(e.description(),
-                                         this->file(currentIndex),
-                                         e.line(),
-                                         e.pos());
+            parseInput(input, length, pInputStream, this->file(currentIndex), options);
+            fixupContextsOnThreads(options);
         }
 
-        fixupContexts();
-        processValue(*this, currentIndex, fileIndexMap, pathBase, openIncludes);
+        checkCancelled(options);
+        if (options.m_openIncludes && !options.m_lazyIncludes && options.m_includeThreads > 0)
+        {
+            IncludeLoader includeLoader(options);
+            includeLoader.scheduleIncludes(*this, pathBase);
+            processValues(currentIndex, fileIndexMap, pathBase, options, &includeLoader);
+        }
+        else
+        {
+            processValues(currentIndex, fileIndexMap, pathBase, options);
+        }
 
         // Undo our temporary refcount change
         this->decrementReferenceNoDestroy();
     }
     catch (...)
     {
+        // The values read so far hold on to us as their context; let go of
+        // them while our temporary refcount still keeps us alive, or the
+        // last of them would delete us again as the constructor unwinds
+        for (size_t i = 0; i < m_values.size(); ++i)
+        {
+            m_values[i]->setContext(NULL);
+        }
         // Undo our temporary refcount change
         this->decrementReferenceNoDestroy();
         // Rethrow the exception
@@ -299,67 +782,378 @@ void File::openBuffer(const std::string& input,
 }
 
 
+void File::parseInput(const char* input,
+                      size_t length,
+                      std::istream* pInputStream,
+                      const std::string& sourceName,
+                      const LoadOptions& options)
+{
+    std::shared_ptr<LineIndex> pLineIndex = std::make_shared<LineIndex>();
+    m_pLineIndex = pLineIndex;
+
+    if (!pInputStream && BinaryFormat::isBinary(input, length))
+    {
+        // Binary data decodes straight into values
+        BinaryFormat::read(input, length, sourceName, m_blockValueNames, m_values, *pLineIndex);
+        return;
+    }
+
+    Parser::Parser parser;
+    parser.setNumThreads(options.m_parseThreads);
+
+    try
+    {
+        if (pInputStream)
+        {
+            parser.parse(*pInputStream, options.m_streamChunkSize, *this, pLineIndex.get());
+        }
+        else
+        {
+            parser.parse(input, length, *this, pLineIndex.get());
+        }
+    }
+    catch (Parser::ParseException& e)
+    {
+        // Re-throw parser exceptions with the correct source name
+        throw Parser::ParseException(e.description(),
+                                     sourceName,
+                                     e.line(),
+                                     e.pos());
+    }
+}
+
+
+void File::copyParsed(const File& parsed)
+{
+    m_pLineIndex = parsed.m_pLineIndex;
+    m_blockValueNames = parsed.m_blockValueNames;
+    m_values.clear();
+    m_values.reserve(parsed.m_values.size());
+    for (size_t i = 0; i < parsed.m_values.size(); ++i)
+    {
+        Value::Ptr pValue = parsed.m_values[i]->clone();
+        copySourceLocations(*parsed.m_values[i], *pValue);
+        m_values.push_back(pValue);
+    }
+    fixupContexts();
+}
+
+
+void File::fixupContextsOnThreads(const LoadOptions& options)
+{
+    size_t numThreads = fixupThreads(options, m_values.size());
+    if (numThreads < 2)
+    {
+        fixupContexts();
+        return;
+    }
+    forValueRanges(numThreads, m_values.size(), [this](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            m_values[i]->setContext(this);
+            m_values[i]->fixupContexts();
+        }
+    });
+}
+
+
+void File::processValues(FileIndex fileIndex,
+                         FileIndexMap& fileIndexMap,
+                         const std::string& pathBase,
+                         const LoadOptions& options,
+                         IncludeLoader* pIncludeLoader)
+{
+    size_t numThreads = fixupThreads(options, m_values.size());
+    if (numThreads < 2)
+    {
+        processValue(*this, fileIndex, fileIndexMap, pathBase, options, pIncludeLoader);
+        return;
+    }
+
+    // Values without includes don't touch the file numbering, so can be
+    // numbered in any order; the rest are seen to in order afterwards
+    std::vector<char> holdsIncludes(m_values.size(), 0);
+    forValueRanges(numThreads, m_values.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            holdsIncludes[i] = !setFileIndexUnlessIncludes(*m_values[i], fileIndex);
+        }
+    });
+
+    setFileIndex(fileIndex);
+    for (size_t i = 0; i < m_values.size(); ++i)
+    {
+        if (holdsIncludes[i])
+        {
+            processMember(*this, i, fileIndex, fileIndexMap, pathBase, options, pIncludeLoader, NULL);
+        }
+    }
+}
+
+
 void File::processValue(Value& v,
                         FileIndex fileIndex,
                         FileIndexMap& fileIndexMap,
                         const std::string& pathBase,
-                        bool openIncludes)
+                        const LoadOptions& options,
+                        IncludeLoader* pIncludeLoader,
+                        ReloadState* pReload)
 {
     v.setFileIndex(fileIndex);
     for (size_t i = 0; i < v.values().size(); ++i)
     {
-        processValue(*v.values()[i],
-                     fileIndex,
-                     fileIndexMap,
-                     pathBase,
-                     openIncludes);
+        processMember(v, i, fileIndex, fileIndexMap, pathBase, options, pIncludeLoader, pReload);
+    }
+}
+
 
-        if (v.values()[i]->isInclude())
+void File::processMember(Value& v,
+                         size_t i,
+                         FileIndex fileIndex,
+                         FileIndexMap& fileIndexMap,
+                         const std::string& pathBase,
+                         const LoadOptions& options,
+                         IncludeLoader* pIncludeLoader,
+                         ReloadState* pReload)
+{
+    processValue(*v.values()[i],
+                 fileIndex,
+                 fileIndexMap,
+                 pathBase,
+                 options,
+                 pIncludeLoader,
+                 pReload);
+
+    if (v.values()[i]->isInclude())
+    {
+        if (options.m_openIncludes)
         {
-            if (openIncludes)
+            m_fileIndexMap.push_back(pathBase + "/" + v.values()[i]->name());
+
+            const std::string filename = m_fileIndexMap.back();
+            std::string includePathBase = includePathBaseOf(filename);
+
+            FilePtr pInclude;
+            if (pIncludeLoader)
             {
-                FilePtr pInclude = new File();
+                pInclude = pIncludeLoader->take(v.values()[i].get());
+            }
 
-                pInclude->setTypeName(v.values()[i]->typeName());
+            FilePtr pPrevious;
+            if (pReload)
+            {
+                pPrevious = pReload->takeInclude(filename);
+            }
 
-                m_fileIndexMap.push_back(pathBase + "/" + v.values()[i]->name());
+            if (pPrevious)
+            {
+                // Included before the reload too; keep the same File, and
+                // only parse it again if it changed as well
+                pInclude = pPrevious;
+                pInclude->reloadChanged(pReload->m_numReloaded);
+            }
+            else if (options.m_lazyIncludes)
+            {
+                // Numbered now, so file indices match an eager load, but
+                // only read and parsed once something searches into it
+                pInclude = new File();
+                pInclude->setTypeName(v.values()[i]->typeName());
                 pInclude->m_fileIndexMap = m_fileIndexMap;
-
-                const std::string& filename = m_fileIndexMap.back();
-
-                // Read all of the input into a string buffer
-                std::string inputBuffer;
-                std::ifstream inputStream(filename.c_str());
-                if (inputStream.fail())
-                {
-                    throw FileIOException(filename, "opened");
-                }
-                while (inputStream.good() && !inputStream.eof())
-                {
-                    std::string inputLine;
-                    getline(inputStream, inputLine);
-                    inputBuffer += inputLine + '\n';
-                }
-
-                std::string includePathBase = "";
-                size_t lastSlash = filename.rfind('/');
-                if (lastSlash != std::string::npos)
-                {
-                    includePathBase = filename.substr(0, lastSlash);
-                }
-
-                pInclude->openBuffer(inputBuffer, m_fileIndexMap, includePathBase, openIncludes);
-                v.setValue(i, pInclude);
+                pInclude->setFileIndex(m_fileIndexMap.size() - 1);
+                pInclude->m_pDeferredInclude.reset(new DeferredInclude());
+                pInclude->m_pDeferredInclude->m_filename = filename;
+                pInclude->m_pDeferredInclude->m_pathBase = includePathBase;
+                pInclude->m_pDeferredInclude->m_options = laterLoadOptions(options);
+                pInclude->m_hasDeferred.store(true, std::memory_order_release);
+            }
+            else if (pInclude)
+            {
+                // Already read and parsed on the loader's threads; number
+                // it and process its own includes here, in serial order
+                pInclude->setTypeName(v.values()[i]->typeName());
+                pInclude->m_fileIndexMap = m_fileIndexMap;
+                pInclude->processValue(*pInclude,
+                                       m_fileIndexMap.size() - 1,
+                                       m_fileIndexMap,
+                                       includePathBase,
+                                       options,
+                                       pIncludeLoader);
             }
             else
             {
-                // Put the include out there, but let it be empty
-                FilePtr pInclude = new File();
+                pInclude = new File();
                 pInclude->setTypeName(v.values()[i]->typeName());
-                v.setValue(i, pInclude);
+                pInclude->m_fileIndexMap = m_fileIndexMap;
+                pInclude->openFile(filename, m_fileIndexMap, includePathBase, options);
             }
+            v.setValue(i, pInclude);
         }
+        else
+        {
+            // Put the include out there, but let it be empty
+            FilePtr pInclude = new File();
+            pInclude->setTypeName(v.values()[i]->typeName());
+            v.setValue(i, pInclude);
+        }
+    }
+}
+
+
+void File::loadDeferredValues() const
+{
+    std::lock_guard<std::mutex> lock(m_deferredIncludeMutex);
+    if (!m_pDeferredInclude)
+    {
+        // Another thread loaded it while we waited
+        return;
     }
+
+    // Load into a separate file, since building the tree looks values up on
+    // it (which would come back here), then take its contents
+    const DeferredInclude& deferred = *m_pDeferredInclude;
+    FilePtr pLoaded = new File();
+    pLoaded->m_fileIndexMap = m_fileIndexMap;
+    pLoaded->openFile(deferred.m_filename,
+                      pLoaded->m_fileIndexMap,
+                      deferred.m_pathBase,
+                      deferred.m_options);
+
+    // Filling in the values of an include doesn't change how it looks from
+    // the outside, so it's fine to do on a const File
+    File& self = const_cast<File&>(*this);
+    self.m_values.swap(pLoaded->m_values);
+    self.m_blockValueNames.swap(pLoaded->m_blockValueNames);
+    self.m_fileIndexMap.swap(pLoaded->m_fileIndexMap);
+    self.m_fileIndex = pLoaded->m_fileIndex;
+    self.m_pSource.swap(pLoaded->m_pSource);
+    self.m_pLineIndex.swap(pLoaded->m_pLineIndex);
+    self.fixupContexts();
+    self.m_pDeferredInclude.reset();
+    m_hasDeferred.store(false, std::memory_order_release);
+}
+
+
+size_t File::reload()
+{
+    size_t numReloaded = 0;
+    reloadChanged(numReloaded);
+    return numReloaded;
+}
+
+
+std::vector<std::string> File::sourceFiles() const
+{
+    std::vector<std::string> files;
+    if (m_hasDeferred.load(std::memory_order_acquire))
+    {
+        // Not loaded yet, so not read from anywhere
+        return files;
+    }
+    if (m_pSource)
+    {
+        files.push_back(m_pSource->m_filename);
+    }
+
+    std::vector<FilePtr> includes;
+    findIncludes(*this, includes);
+    for (size_t i = 0; i < includes.size(); ++i)
+    {
+        std::vector<std::string> includeFiles = includes[i]->sourceFiles();
+        files.insert(files.end(), includeFiles.begin(), includeFiles.end());
+    }
+    return files;
+}
+
+
+void File::recordSource(const std::string& filename,
+                        const std::string& pathBase,
+                        const LoadOptions& options)
+{
+    if (options.m_pBundle)
+    {
+        // Bundled files never change
+        m_pSource.reset();
+        return;
+    }
+
+    // Look at the file before reading it, so an edit made while it is being
+    // read gets picked up by the next reload
+    m_pSource.reset(new SourceFile());
+    m_pSource->m_filename = filename;
+    m_pSource->m_pathBase = pathBase;
+    m_pSource->m_options = laterLoadOptions(options);
+    std::string path;
+    if (!fileSignature(filename, path, m_pSource->m_modifiedTime, m_pSource->m_size))
+    {
+        m_pSource->m_modifiedTime = -1;
+        m_pSource->m_size = -1;
+    }
+}
+
+
+void File::reloadChanged(size_t& numReloaded)
+{
+    if (m_hasDeferred.load(std::memory_order_acquire))
+    {
+        // Never loaded, so it will be read fresh when first needed
+        return;
+    }
+
+    std::vector<FilePtr> includes;
+    findIncludes(*this, includes);
+
+    if (!m_pSource || !m_pSource->changedOnDisk())
+    {
+        for (size_t i = 0; i < includes.size(); ++i)
+        {
+            includes[i]->reloadChanged(numReloaded);
+        }
+        return;
+    }
+
+    // Hand the current includes over to be reattached where the new contents
+    // include the same files
+    ReloadState reload(numReloaded);
+    for (size_t i = 0; i < includes.size(); ++i)
+    {
+        const File& include = *includes[i];
+        if (include.m_pSource)
+        {
+            reload.m_includes.insert(std::make_pair(include.m_pSource->m_filename, includes[i]));
+        }
+        else if (include.m_pDeferredInclude)
+        {
+            reload.m_includes.insert(std::make_pair(include.m_pDeferredInclude->m_filename, includes[i]));
+        }
+    }
+
+    // Build the new contents on the side, so a file that fails to parse
+    // leaves the old ones alone.  Files this one includes are numbered after
+    // it, just like when it was first loaded.
+    const SourceFile source = *m_pSource;
+    FileIndex fileIndex = std::min<FileIndex>(m_fileIndex, m_fileIndexMap.size() - 1);
+    FilePtr pLoaded = new File();
+    pLoaded->m_fileIndexMap.assign(m_fileIndexMap.begin(), m_fileIndexMap.begin() + fileIndex + 1);
+    pLoaded->recordSource(source.m_filename, source.m_pathBase, source.m_options);
+    pLoaded->readFile(source.m_filename, source.m_options);
+    pLoaded->processValue(*pLoaded,
+                          fileIndex,
+                          pLoaded->m_fileIndexMap,
+                          source.m_pathBase,
+                          source.m_options,
+                          NULL,
+                          &reload);
+
+    m_values.swap(pLoaded->m_values);
+    m_blockValueNames.swap(pLoaded->m_blockValueNames);
+    m_fileIndexMap.swap(pLoaded->m_fileIndexMap);
+    m_fileIndex = pLoaded->m_fileIndex;
+    m_pSource.swap(pLoaded->m_pSource);
+    m_pLineIndex.swap(pLoaded->m_pLineIndex);
+    fixupContexts();
+    ++numReloaded;
 }
 
 
@@ -395,5 +1189,35 @@ std::string File::file(FileIndex index) const
 }
 
 
+bool File::locate(FileIndex index, size_t offset, size_t& outLine, size_t& outColumn) const
+{
+    // Values parsed from this file (including ones not numbered, such as
+    // macro arguments) are located in its text; anything else in an
+    // enclosing file
+    if (m_pLineIndex && (index == m_fileIndex || index == kNotFromFile))
+    {
+        m_pLineIndex->locate(offset, outLine, outColumn);
+        return true;
+    }
+    return Value::locate(index, offset, outLine, outColumn);
+}
+
+
+//
+// FileLoad
+//
+
+bool FileLoad::isReady() const
+{
+    return waitFor(std::chrono::milliseconds(0));
+}
+
+
+bool FileLoad::waitFor(const std::chrono::milliseconds& timeout) const
+{
+    return m_future.wait_for(timeout) == std::future_status::ready;
+}
+
+
     } // namespace Rsd
 } // namespace RenderSpud
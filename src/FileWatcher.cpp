@@ -0,0 +1,248 @@
+////////////
+//
+//  File:      FileWatcher.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Reload a file when it or its includes change on disk
+//
+////////////
+
+#if defined(__linux__)
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <Rsd/FileWatcher.h>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+namespace
+{
+
+/// How long to wait for a burst of notifications (an editor writing a
+/// temporary file, renaming it, fixing permissions...) to settle before
+/// reloading
+const int kSettleMilliseconds = 50;
+
+
+/// Split a path into its directory and the name within it
+std::pair<std::string, std::string> splitPath(const std::string& filename)
+{
+    size_t lastSlash = filename.rfind('/');
+    if (lastSlash == std::string::npos)
+    {
+        return std::make_pair(std::string("."), filename);
+    }
+    if (lastSlash == 0)
+    {
+        return std::make_pair(std::string("/"), filename.substr(1));
+    }
+    return std::make_pair(filename.substr(0, lastSlash), filename.substr(lastSlash + 1));
+}
+
+
+/// The one spelling of a directory, with symlinks, "." and ".." resolved, so
+/// that a directory reached by several paths (./a.rsd and /abs/a.rsd) is
+/// watched and matched under one name.  Gives the path as it is if it can't
+/// be resolved (e.g. it doesn't exist right now).
+std::string canonicalDirectory(const std::string& directory)
+{
+#if defined(__linux__)
+    char* pResolved = ::realpath(directory.c_str(), NULL);
+    if (pResolved)
+    {
+        std::string resolved(pResolved);
+        std::free(pResolved);
+        return resolved;
+    }
+#endif
+    return directory;
+}
+
+}
+
+
+FileWatcher::FileWatcher(File::FilePtr pFile)
+    : m_pFile(pFile), m_fd(-1), m_watchedDirectories(), m_watchedFiles()
+{
+#if defined(__linux__)
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    watchSourceFiles();
+}
+
+
+FileWatcher::~FileWatcher()
+{
+#if defined(__linux__)
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+#endif
+}
+
+
+size_t FileWatcher::poll(int timeoutMilliseconds)
+{
+    if (!isNotified())
+    {
+        // Nothing will tell us about changes, so wait and then look at every
+        // file ourselves
+        while (true)
+        {
+            if (timeoutMilliseconds != 0)
+            {
+                int wait = timeoutMilliseconds > 0 ? timeoutMilliseconds : 1000;
+                std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+            }
+            size_t numReloaded = m_pFile->reload();
+            if (numReloaded > 0 || timeoutMilliseconds >= 0)
+            {
+                return numReloaded;
+            }
+        }
+    }
+
+    // Includes may have been loaded (lazily, or by an earlier reload) since
+    // we last looked
+    watchSourceFiles();
+
+    if (!readNotifications(timeoutMilliseconds))
+    {
+        return 0;
+    }
+    while (readNotifications(kSettleMilliseconds))
+    {
+    }
+
+    size_t numReloaded = m_pFile->reload();
+    watchSourceFiles();
+    return numReloaded;
+}
+
+
+void FileWatcher::watchSourceFiles()
+{
+    std::vector<std::string> files = m_pFile->sourceFiles();
+    m_watchedFiles.clear();
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        std::pair<std::string, std::string> directoryAndName = splitPath(files[i]);
+        directoryAndName.first = canonicalDirectory(directoryAndName.first);
+        m_watchedFiles.insert(directoryAndName);
+    }
+
+#if defined(__linux__)
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    std::set<std::string> directories;
+    for (std::map<int, std::string>::const_iterator iter = m_watchedDirectories.begin();
+         iter != m_watchedDirectories.end();
+         ++iter)
+    {
+        directories.insert(iter->second);
+    }
+
+    for (std::set<std::pair<std::string, std::string> >::const_iterator iter = m_watchedFiles.begin();
+         iter != m_watchedFiles.end();
+         ++iter)
+    {
+        if (directories.count(iter->first))
+        {
+            continue;
+        }
+        int wd = ::inotify_add_watch(m_fd,
+                                     iter->first.c_str(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+        if (wd >= 0)
+        {
+            m_watchedDirectories[wd] = iter->first;
+            directories.insert(iter->first);
+        }
+    }
+#endif
+}
+
+
+bool FileWatcher::readNotifications(int timeoutMilliseconds)
+{
+#if defined(__linux__)
+    struct pollfd pollFd;
+    pollFd.fd = m_fd;
+    pollFd.events = POLLIN;
+    pollFd.revents = 0;
+    int numReady = ::poll(&pollFd, 1, timeoutMilliseconds);
+    if (numReady <= 0)
+    {
+        return false;
+    }
+
+    bool sourceChanged = false;
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    while (true)
+    {
+        ssize_t length = ::read(m_fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length <= 0)
+        {
+            break;
+        }
+
+        const char* pEnd = buffer + length;
+        for (const char* p = buffer; p < pEnd; )
+        {
+            const struct inotify_event* pEvent = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + pEvent->len;
+
+            if (pEvent->mask & IN_Q_OVERFLOW)
+            {
+                // Lost track; let the reload look at everything
+                sourceChanged = true;
+                continue;
+            }
+            if (pEvent->mask & IN_IGNORED)
+            {
+                // The directory went away; watch it again if it comes back
+                m_watchedDirectories.erase(pEvent->wd);
+                continue;
+            }
+            std::map<int, std::string>::const_iterator directory = m_watchedDirectories.find(pEvent->wd);
+            if (directory == m_watchedDirectories.end() || pEvent->len == 0)
+            {
+                continue;
+            }
+            if (m_watchedFiles.count(std::make_pair(directory->second, std::string(pEvent->name))))
+            {
+                sourceChanged = true;
+            }
+        }
+    }
+    return sourceChanged;
+#else
+    return false;
+#endif
+}
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
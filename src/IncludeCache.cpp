@@ -0,0 +1,201 @@
+////////////
+//
+//  File:      IncludeCache.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Process-wide cache of parsed files
+//
+////////////
+
+#include <Rsd/IncludeCache.h>
+
+#include "MappedFile.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+namespace
+{
+
+const size_t kDefaultMemoryBudget = 256 * 1024 * 1024;
+
+
+/// Rough memory held by a parsed tree: the nodes and member names, with the
+/// source text standing in for the strings and references they hold
+size_t estimateMemory(const Value& v)
+{
+    size_t bytes = sizeof(Value) + v.values().size() * sizeof(Value::Ptr);
+    for (size_t i = 0; i < v.names().size(); ++i)
+    {
+        bytes += sizeof(std::string) + v.names()[i].capacity();
+    }
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        bytes += estimateMemory(*v.values()[i]);
+    }
+    return bytes;
+}
+
+}
+
+
+IncludeCache& IncludeCache::instance()
+{
+    static IncludeCache sInstance;
+    return sInstance;
+}
+
+
+IncludeCache::IncludeCache()
+    : m_mutex(), m_entries(), m_entryMap(), m_memoryBudget(kDefaultMemoryBudget),
+      m_memoryUsed(0), m_numHits(0), m_numMisses(0), m_numEvictions(0)
+{
+
+}
+
+
+IncludeCache::~IncludeCache()
+{
+
+}
+
+
+File::ConstFilePtr IncludeCache::acquire(const std::string& filename)
+{
+    std::string path;
+    long long modifiedTime, fileSize;
+    if (!fileSignature(filename, path, modifiedTime, fileSize))
+    {
+        throw FileIOException(filename, "opened");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        EntryMap::iterator found = m_entryMap.find(path);
+        if (found != m_entryMap.end())
+        {
+            Entry& entry = *found->second;
+            if (entry.m_modifiedTime == modifiedTime && entry.m_size == fileSize)
+            {
+                // Move to the front as most recently used
+                m_entries.splice(m_entries.begin(), m_entries, found->second);
+                ++m_numHits;
+                return entry.m_pFile;
+            }
+        }
+        ++m_numMisses;
+    }
+
+    // Parse without holding the lock, so other files can be parsed and
+    // served meanwhile
+    MappedFile input(filename);
+    if (!input.isOpen())
+    {
+        throw FileIOException(filename, "opened");
+    }
+    File::FilePtr pFile = new File();
+    pFile->parseInput(input.data(), input.size(), NULL, filename, LoadOptions());
+
+    Entry entry;
+    entry.m_path = path;
+    entry.m_modifiedTime = modifiedTime;
+    entry.m_size = fileSize;
+    entry.m_memory = estimateMemory(*pFile) + input.size();
+    entry.m_pFile = pFile;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    EntryMap::iterator found = m_entryMap.find(path);
+    if (found != m_entryMap.end())
+    {
+        m_memoryUsed -= found->second->m_memory;
+        m_entries.erase(found->second);
+        m_entryMap.erase(found);
+    }
+    m_entries.push_front(entry);
+    m_entryMap[path] = m_entries.begin();
+    m_memoryUsed += entry.m_memory;
+    evict();
+    return entry.m_pFile;
+}
+
+
+void IncludeCache::evict()
+{
+    // Always keep the most recent file, even if it is over budget by itself
+    while (m_memoryUsed > m_memoryBudget && m_entries.size() > 1)
+    {
+        Entry& oldest = m_entries.back();
+        m_memoryUsed -= oldest.m_memory;
+        m_entryMap.erase(oldest.m_path);
+        m_entries.pop_back();
+        ++m_numEvictions;
+    }
+}
+
+
+void IncludeCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_entryMap.clear();
+    m_memoryUsed = 0;
+}
+
+
+size_t IncludeCache::memoryBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBudget;
+}
+
+
+void IncludeCache::setMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_memoryBudget = bytes;
+    evict();
+}
+
+
+size_t IncludeCache::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryUsed;
+}
+
+
+size_t IncludeCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+
+size_t IncludeCache::numHits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numHits;
+}
+
+
+size_t IncludeCache::numMisses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numMisses;
+}
+
+
+size_t IncludeCache::numEvictions() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_numEvictions;
+}
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
@@ -0,0 +1,129 @@
+////////////
+//
+//  File:      LineIndex.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Line starts of parsed text, for turning offsets into lines
+//
+////////////
+
+#include <algorithm>
+
+#include <Rsd/Platform.h>
+
+#include "LineIndex.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+namespace
+{
+
+#if RS_SSE_SIMD && defined(__SSE2__)
+
+const size_t kScanWidth = 16;
+
+
+/// Index of the lowest set bit (mask must not be zero)
+inline unsigned int lowestSetBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return static_cast<unsigned int>(bit);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+#endif
+
+}
+
+
+void LineIndex::append(const char* text, size_t length)
+{
+    const size_t base = m_length;
+    size_t index = 0;
+
+#if RS_SSE_SIMD && defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    for (; index + kScanWidth <= length; index += kScanWidth)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + index));
+        unsigned int breaks = static_cast<unsigned int>(
+            _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, newline),
+                                           _mm_cmpeq_epi8(chunk, carriageReturn))));
+        while (breaks)
+        {
+            size_t i = index + lowestSetBit(breaks);
+            lineBreakAt(text, i, base);
+            breaks &= breaks - 1;
+        }
+    }
+#endif
+    for (; index < length; ++index)
+    {
+        if (text[index] == '\n' || text[index] == '\r')
+        {
+            lineBreakAt(text, index, base);
+        }
+    }
+
+    if (length > 0)
+    {
+        m_endsWithReturn = text[length - 1] == '\r';
+    }
+    m_length += length;
+}
+
+
+void LineIndex::lineBreakAt(const char* text, size_t index, size_t base)
+{
+    // A "\n" right after a "\r" ends the same line, so the line starts after
+    // the "\n" instead
+    bool afterReturn = index > 0 ? text[index - 1] == '\r' : m_endsWithReturn;
+    if (text[index] == '\n' && afterReturn)
+    {
+        m_lineStarts.back() = base + index + 1;
+    }
+    else
+    {
+        m_lineStarts.push_back(base + index + 1);
+    }
+}
+
+
+void LineIndex::locate(size_t offset, size_t& outLine, size_t& outColumn) const
+{
+    // The last line starting at or before the offset
+    LineStarts::const_iterator after = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), offset);
+    outLine = static_cast<size_t>(after - m_lineStarts.begin());
+    outColumn = offset - *(after - 1);
+}
+
+
+void LineIndex::assign(const LineStarts& lineStarts, size_t length)
+{
+    m_lineStarts = lineStarts;
+    if (m_lineStarts.empty() || m_lineStarts[0] != 0)
+    {
+        m_lineStarts.insert(m_lineStarts.begin(), 0);
+    }
+    m_length = length;
+    m_endsWithReturn = false;
+}
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
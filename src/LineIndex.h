@@ -0,0 +1,79 @@
+////////////
+//
+//  File:      LineIndex.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Line starts of parsed text, for turning offsets into lines
+//
+////////////
+
+#ifndef __RSD_LineIndex_h__
+#define __RSD_LineIndex_h__
+
+#include <vector>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+/// Where each line of some text starts, so tokens and values only need to
+/// remember a byte offset; the line and column are worked out from it when
+/// someone asks.  "\n", "\r\n" and a lone "\r" each end a line.
+class LineIndex
+{
+public:
+    typedef std::vector<size_t> LineStarts;
+
+    LineIndex() : m_lineStarts(1, 0), m_length(0), m_endsWithReturn(false) { }
+
+    /// Index the whole of some text
+    LineIndex(const char* text, size_t length)
+        : m_lineStarts(1, 0), m_length(0), m_endsWithReturn(false)
+    {
+        append(text, length);
+    }
+
+    /// Forget all the text indexed so far, to index some other text
+    void clear()
+    {
+        m_lineStarts.resize(1);
+        m_length = 0;
+        m_endsWithReturn = false;
+    }
+
+    /// Index more text following what was appended before (such as the next
+    /// chunk of a stream); a "\r\n" may be split between the two
+    void append(const char* text, size_t length);
+
+    /// Line (from 1) and column (from 0) of a byte offset into the text
+    void locate(size_t offset, size_t& outLine, size_t& outColumn) const;
+
+    /// How many bytes of text have been indexed
+    size_t length() const { return m_length; }
+
+    /// The offset each line starts at, the first always being 0
+    const LineStarts& lineStarts() const { return m_lineStarts; }
+
+    /// Take over a list of line starts (such as one stored with binary data)
+    /// for text of the given length
+    void assign(const LineStarts& lineStarts, size_t length);
+
+private:
+    /// Note the line break character at text[index], text starting at base
+    void lineBreakAt(const char* text, size_t index, size_t base);
+
+    LineStarts m_lineStarts;
+    size_t m_length;
+    bool m_endsWithReturn;
+};
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_LineIndex_h__
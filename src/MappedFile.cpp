@@ -0,0 +1,230 @@
+////////////
+//
+//  File:      MappedFile.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Read-only memory-mapped file access for loading
+//
+////////////
+
+#if defined(_WIN32)
+    #include <fstream>
+    #include <sstream>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <stdlib.h>
+#else
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <climits>
+    #include <cstdlib>
+#endif
+
+#include "MappedFile.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+MappedFile::MappedFile()
+    : m_pData(""), m_size(0), m_isOpen(false), m_isMapped(false), m_buffer()
+{
+
+}
+
+
+MappedFile::MappedFile(const std::string& filename)
+    : m_pData(""), m_size(0), m_isOpen(false), m_isMapped(false), m_buffer()
+{
+    open(filename);
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+    std::ifstream inputStream(filename.c_str(), std::ios::in | std::ios::binary);
+    if (inputStream.fail())
+    {
+        return false;
+    }
+    std::ostringstream contents;
+    contents << inputStream.rdbuf();
+    m_buffer = contents.str();
+    m_pData = m_buffer.data();
+    m_size = m_buffer.size();
+    m_isOpen = true;
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    m_buffer.clear();
+    m_pData = "";
+    m_size = 0;
+    m_isOpen = false;
+    m_isMapped = false;
+}
+
+
+bool MappedFile::readAll(int fd)
+{
+    return false;
+}
+
+#else
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    if (S_ISREG(fileStat.st_mode) && fileStat.st_size > 0)
+    {
+#ifdef POSIX_FADV_SEQUENTIAL
+        // Ask for aggressive readahead before we touch any pages
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        size_t length = static_cast<size_t>(fileStat.st_size);
+        void *pMapping = ::mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pMapping != MAP_FAILED)
+        {
+#ifdef MADV_SEQUENTIAL
+            ::madvise(pMapping, length, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+            ::madvise(pMapping, length, MADV_WILLNEED);
+#endif
+            // The mapping stays valid after the descriptor is closed
+            ::close(fd);
+            m_pData = static_cast<const char*>(pMapping);
+            m_size = length;
+            m_isMapped = true;
+            m_isOpen = true;
+            return true;
+        }
+    }
+    else if (S_ISDIR(fileStat.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Not mappable (empty, a pipe, a special file, ...); just read it all
+    bool success = readAll(fd);
+    ::close(fd);
+    return success;
+}
+
+
+void MappedFile::close()
+{
+    if (m_isMapped)
+    {
+        ::munmap(const_cast<char*>(m_pData), m_size);
+    }
+    m_buffer.clear();
+    m_pData = "";
+    m_size = 0;
+    m_isOpen = false;
+    m_isMapped = false;
+}
+
+
+bool MappedFile::readAll(int fd)
+{
+    const size_t kReadSize = 64 * 1024;
+    size_t used = 0;
+    while (true)
+    {
+        if (m_buffer.size() < used + kReadSize)
+        {
+            m_buffer.resize(used + kReadSize);
+        }
+        ssize_t numRead = ::read(fd, &m_buffer[used], kReadSize);
+        if (numRead < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            m_buffer.clear();
+            return false;
+        }
+        if (numRead == 0)
+            break;
+        used += static_cast<size_t>(numRead);
+    }
+    m_buffer.resize(used);
+    m_pData = m_buffer.data();
+    m_size = used;
+    m_isOpen = true;
+    return true;
+}
+
+#endif
+
+
+/// Canonical path plus modification time and size of a file; false if it
+/// does not exist
+bool fileSignature(const std::string& filename,
+                   std::string& outPath,
+                   long long& outModifiedTime,
+                   long long& outSize)
+{
+#if defined(_WIN32)
+    struct _stat64 fileStat;
+    if (_stat64(filename.c_str(), &fileStat) != 0)
+        return false;
+    char fullPath[_MAX_PATH];
+    outPath = _fullpath(fullPath, filename.c_str(), _MAX_PATH) ? fullPath : filename;
+    outModifiedTime = static_cast<long long>(fileStat.st_mtime) * 1000000000LL;
+#else
+    struct stat fileStat;
+    if (::stat(filename.c_str(), &fileStat) != 0)
+        return false;
+    char fullPath[PATH_MAX];
+    outPath = ::realpath(filename.c_str(), fullPath) ? fullPath : filename;
+#if defined(__APPLE__)
+    outModifiedTime = static_cast<long long>(fileStat.st_mtimespec.tv_sec) * 1000000000LL +
+                      fileStat.st_mtimespec.tv_nsec;
+#else
+    outModifiedTime = static_cast<long long>(fileStat.st_mtim.tv_sec) * 1000000000LL +
+                      fileStat.st_mtim.tv_nsec;
+#endif
+#endif
+    outSize = static_cast<long long>(fileStat.st_size);
+    return true;
+}
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
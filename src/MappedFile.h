@@ -0,0 +1,76 @@
+////////////
+//
+//  File:      MappedFile.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Read-only memory-mapped file access for loading
+//
+////////////
+
+#ifndef __RSD_MappedFile_h__
+#define __RSD_MappedFile_h__
+
+#include <string>
+
+#include <Rsd/Platform.h>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+/// Read-only view of the entire contents of a file.  Where the platform
+/// allows, the file is memory-mapped and the kernel is told we will read it
+/// front-to-back, so the parser can run directly over the mapped bytes with
+/// readahead going on underneath.  Anything that cannot be mapped (pipes,
+/// special files, platforms without mmap) is read in one go into a buffer.
+class MappedFile
+{
+public:
+    MappedFile();
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    /// Map (or read) the file; returns false if it could not be opened.
+    bool open(const std::string& filename);
+    /// Unmap the file and release any buffered data.
+    void close();
+
+    bool isOpen() const { return m_isOpen; }
+
+    /// The file contents (not null-terminated)
+    const char* data() const { return m_pData; }
+    /// Number of bytes in the file
+    size_t      size() const { return m_size; }
+
+private:
+    // Forbidden
+    MappedFile(const MappedFile&);
+    MappedFile& operator =(const MappedFile&);
+
+    bool readAll(int fd);
+
+    const char* m_pData;
+    size_t m_size;
+    bool m_isOpen;
+    bool m_isMapped;
+    std::string m_buffer;
+};
+
+
+/// Canonical path plus modification time and size of a file; false if it
+/// does not exist
+bool fileSignature(const std::string& filename,
+                   std::string& outPath,
+                   long long& outModifiedTime,
+                   long long& outSize);
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_MappedFile_h__
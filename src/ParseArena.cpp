@@ -0,0 +1,64 @@
+////////////
+//
+//  File:      ParseArena.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Memory for the intermediate values of a single parse
+//
+////////////
+
+#include <algorithm>
+
+#include "ParseArena.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+        namespace Parser
+        {
+
+
+void* ParseArena::allocate(size_t size)
+{
+    size = roundUp(size);
+    if (size > kBlockSize / 4)
+    {
+        // Big allocations get a block to themselves, leaving the current
+        // block to carry on with
+        m_bigBlocks.push_back(std::unique_ptr<std::max_align_t[]>(new std::max_align_t[size / sizeof(std::max_align_t) + 1]));
+        return m_bigBlocks.back().get();
+    }
+    if (static_cast<size_t>(m_pEnd - m_pNext) < size)
+    {
+        m_blocks.push_back(std::unique_ptr<std::max_align_t[]>(new std::max_align_t[kBlockSize / sizeof(std::max_align_t)]));
+        m_pNext = reinterpret_cast<char*>(m_blocks.back().get());
+        m_pEnd = m_pNext + kBlockSize;
+    }
+    void* pMemory = m_pNext;
+    m_pNext += size;
+    return pMemory;
+}
+
+
+void ParseArena::reset()
+{
+    m_bigBlocks.clear();
+    if (m_blocks.size() > 1)
+    {
+        m_blocks.erase(m_blocks.begin() + 1, m_blocks.end());
+    }
+    if (!m_blocks.empty())
+    {
+        m_pNext = reinterpret_cast<char*>(m_blocks.front().get());
+        m_pEnd = m_pNext + kBlockSize;
+    }
+    std::fill(m_freeSlots.begin(), m_freeSlots.end(), static_cast<FreeSlot*>(NULL));
+}
+
+
+        } // namespace Parser
+    } // namespace Rsd
+} // namespace RenderSpud
@@ -0,0 +1,135 @@
+////////////
+//
+//  File:      ParseArena.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Memory for the intermediate values of a single parse
+//
+////////////
+
+#ifndef __RSD_ParseArena_h__
+#define __RSD_ParseArena_h__
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+        namespace Parser
+        {
+
+
+/// \brief Memory for the semantic values the lemon parser's rules build,
+/// which live only until the rule using them reduces.
+///
+/// Objects are carved out of large blocks instead of being allocated one by
+/// one.  Destroying an object runs its destructor and keeps its slot for the
+/// next object of the same size, so the arena only grows with the number of
+/// values alive at once, not with the size of the input.  Everything is
+/// released in one go when the arena goes away (even if the parse threw);
+/// objects still alive then are not destroyed.  An arena can be reset to be
+/// used again for another parse, keeping a block around for it.
+class ParseArena
+{
+public:
+    ParseArena() : m_blocks(), m_bigBlocks(), m_pNext(NULL), m_pEnd(NULL), m_freeSlots() { }
+
+    /// Raw memory, aligned for any type
+    void* allocate(size_t size);
+
+    /// Release everything allocated so far, all at once, keeping the first
+    /// block to carry on allocating from.  Objects still alive are not
+    /// destroyed.
+    void reset();
+
+    template <class T, class... Args>
+    T* create(Args&&... args)
+    {
+        return new (allocateSlot(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// Destroy an object made by create (destroying NULL does nothing)
+    template <class T>
+    void destroy(T* pObject)
+    {
+        if (!pObject)
+        {
+            return;
+        }
+        pObject->~T();
+        freeSlot(pObject, sizeof(T));
+    }
+
+private:
+    // Forbidden
+    ParseArena(const ParseArena&);
+    ParseArena& operator =(const ParseArena&);
+
+    static const size_t kAlignment = alignof(std::max_align_t);
+    static const size_t kBlockSize = 64 * 1024;
+    static const size_t kMaxSlotSize = 256;
+
+    static size_t roundUp(size_t size) { return (size + kAlignment - 1) & ~(kAlignment - 1); }
+
+    /// Memory for an object, reusing a freed slot of the same size if any
+    void* allocateSlot(size_t size)
+    {
+        size = roundUp(size);
+        if (size <= kMaxSlotSize && m_freeSlots.size() > size / kAlignment)
+        {
+            FreeSlot*& pFree = m_freeSlots[size / kAlignment];
+            if (pFree)
+            {
+                FreeSlot* pSlot = pFree;
+                pFree = pSlot->m_pNext;
+                return pSlot;
+            }
+        }
+        return allocate(size);
+    }
+
+    /// Keep an object's memory for the next one of the same size
+    void freeSlot(void* pObject, size_t size)
+    {
+        size = roundUp(size);
+        if (size > kMaxSlotSize)
+        {
+            return;
+        }
+        if (m_freeSlots.size() <= size / kAlignment)
+        {
+            m_freeSlots.resize(size / kAlignment + 1, NULL);
+        }
+        FreeSlot* pSlot = static_cast<FreeSlot*>(pObject);
+        pSlot->m_pNext = m_freeSlots[size / kAlignment];
+        m_freeSlots[size / kAlignment] = pSlot;
+    }
+
+    struct FreeSlot
+    {
+        FreeSlot* m_pNext;
+    };
+
+    std::vector< std::unique_ptr<std::max_align_t[]> > m_blocks;
+    // Allocations too big to share a block
+    std::vector< std::unique_ptr<std::max_align_t[]> > m_bigBlocks;
+    char* m_pNext;
+    char* m_pEnd;
+    // Freed slots, by size in units of kAlignment
+    std::vector<FreeSlot*> m_freeSlots;
+};
+
+
+        } // namespace Parser
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_ParseArena_h__
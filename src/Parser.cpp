@@ -8,12 +8,19 @@
 //
 ////////////
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
 #include <string>
-#include <vector>
+#include <thread>
 
 #include <Rsd/Parser.h>
 
-#include "Tokenizer.h"
+#include "LineIndex.h"
+#include "ParseArena.h"
+#include "ThreadPool.h"
+#include "TokenStream.h"
 
 
 //
@@ -23,6 +30,9 @@
 void  ParseFree(void *p,                  // The parser to be deleted
                 void (*freeProc)(void*)); // Function used to reclaim memory
 void* ParseAlloc(void *(*mallocProc)(size_t));
+size_t ParseSize();                       // Memory needed for a parser
+void  ParseInit(void *p);                 // Set up a parser in that memory
+void  ParseFinalize(void *p);             // Clear out a parser, keeping its memory
 void  ParseTrace(FILE *traceFile, char *zTracePrompt);
 void  Parse(void *yyp,                                     // The parser
             int yymajor,                                   // The major token code number
@@ -37,6 +47,9 @@ void  Parse(void *yyp,                                     // The parser
 void  ReferenceParseFree(void *p,                  // The parser to be deleted
                          void (*freeProc)(void*)); // Function used to reclaim memory
 void* ReferenceParseAlloc(void *(*mallocProc)(size_t));
+size_t ReferenceParseSize();                       // Memory needed for a parser
+void  ReferenceParseInit(void *p);                 // Set up a parser in that memory
+void  ReferenceParseFinalize(void *p);             // Clear out a parser, keeping its memory
 void  ReferenceParseTrace(FILE *traceFile, char *zTracePrompt);
 void  ReferenceParse(void *yyp,                                     // The parser
                      int yymajor,                                   // The major token code number
@@ -113,109 +126,573 @@ int tokenTypeToLemonId(GrammarVariant variant, TokenType type)
 }
 
 
-void Parser::parse(const std::string& input, Value& root)
+void ParserState::locate(size_t offset, size_t& outLine, size_t& outColumn) const
 {
-    //
-    // Tokenize / parse input into AST
-    //
+    if (m_pLineIndex)
+    {
+        m_pLineIndex->locate(offset, outLine, outColumn);
+    }
+    else
+    {
+        outLine = 1;
+        outColumn = offset;
+    }
+}
 
-    ParserState state(root);
-    void *pParser = ParseAlloc(&(::operator new));
-    size_t index = 0;
-    std::vector<Token*> tokens;
-    while (index < input.length())
+
+namespace
+{
+
+typedef void (*GrammarFunction)(void*, int, Token*, ParserState*);
+
+
+/// Pull every token out of the stream and feed it to the grammar, then tell
+/// the grammar the input is done.  The grammar copies out whatever it needs
+/// of a token before the stream reuses it.
+void feedTokens(TokenStream& tokens,
+                GrammarVariant variant,
+                GrammarFunction grammar,
+                void* pParser,
+                ParserState& state)
+{
+    while (true)
     {
-        tokens.push_back(new Token());
-        Token& token = *tokens.back();
+        Token* pToken;
         try
         {
-            index = Token::parseToken(index,
-                                      input,
-                                      token,
-                                      state.m_currentLine,
-                                      state.m_currentPosition);
+            pToken = tokens.next();
         }
-        catch (TokenException tokenException)
+        catch (TokenException& tokenException)
         {
             // Rethrow token exceptions as parse errors, with more information
+            size_t line, column;
+            state.locate(tokenException.offset(), line, column);
             throw ParseException(std::string("Syntax error: ") + tokenException.what(),
                                  state.m_currentSource,
-                                 tokenException.line(),
-                                 tokenException.position());
+                                 line,
+                                 column);
         }
 
-        // Feed tokens to the parser
-        if (token.type() != kTokenWhitespace)
+        state.m_currentOffset = tokens.offset();
+        if (!pToken)
+        {
+            break;
+        }
+        grammar(pParser, tokenTypeToLemonId(variant, pToken->type()), pToken, &state);
+    }
+    grammar(pParser, 0, NULL, &state);
+}
+
+}
+
+
+ParseContext::ParseContext()
+    : m_pArena(new ParseArena()),
+      m_pLines(new LineIndex()),
+      m_pMainParser(NULL),
+      m_pReferenceParser(NULL),
+      m_inUse(false)
+{
+
+}
+
+
+ParseContext::~ParseContext()
+{
+    delete [] static_cast<std::max_align_t*>(m_pMainParser);
+    delete [] static_cast<std::max_align_t*>(m_pReferenceParser);
+    delete m_pLines;
+    delete m_pArena;
+}
+
+
+ParseContext& ParseContext::threadDefault()
+{
+    static thread_local ParseContext s_context;
+    return s_context;
+}
+
+
+/// Borrows a context for the length of one parse, and gets it ready for the
+/// next one when the parse is done (or has thrown).
+class ContextUse
+{
+public:
+    ContextUse(ParseContext* pContext)
+        : m_pOwnContext(),
+          m_pContext(pContext ? pContext : &ParseContext::threadDefault())
+    {
+        if (m_pContext->m_inUse)
         {
-            Parse(pParser,
-                  tokenTypeToLemonId(kMainGrammar, token.type()),
-                  &token,
-                  &state);
+            m_pOwnContext.reset(new ParseContext());
+            m_pContext = m_pOwnContext.get();
         }
+        m_pContext->m_inUse = true;
+        m_pContext->m_pLines->clear();
     }
 
-    // Clean up the parser
-    Parse(pParser, 0, NULL, &state);
-    ParseFree(pParser, &(::operator delete));
+    ~ContextUse()
+    {
+        m_pContext->m_pArena->reset();
+        m_pContext->m_inUse = false;
+    }
+
+    ParseArena& arena()  { return *m_pContext->m_pArena; }
+    LineIndex&  lines()  { return *m_pContext->m_pLines; }
+
+    /// The context's main grammar parser, set up for a new parse
+    void* mainParser()
+    {
+        return startParser(m_pContext->m_pMainParser, ParseSize(), &ParseInit);
+    }
+
+    /// The context's reference grammar parser, set up for a new parse
+    void* referenceParser()
+    {
+        return startParser(m_pContext->m_pReferenceParser, ReferenceParseSize(), &ReferenceParseInit);
+    }
+
+private:
+    // Forbidden
+    ContextUse(const ContextUse&);
+    ContextUse& operator =(const ContextUse&);
+
+    static void* startParser(void*& pParser, size_t size, void (*init)(void*))
+    {
+        if (!pParser)
+        {
+            pParser = new std::max_align_t[size / sizeof(std::max_align_t) + 1];
+        }
+        init(pParser);
+        return pParser;
+    }
+
+    std::unique_ptr<ParseContext> m_pOwnContext;
+    ParseContext *m_pContext;
+};
+
+
+/// One of a context's lemon parsers, for the length of one parse.  It is
+/// finalized when the parse is done, or has thrown part way through, which
+/// hands whatever the rules had built so far to the grammar's destructors.
+/// Those use the arena of the state the parser was fed, so the state must
+/// outlive this.
+class ParserUse
+{
+public:
+    ParserUse(void* pParser, void (*finalize)(void*))
+        : m_pParser(pParser), m_finalize(finalize) { }
+
+    ~ParserUse() { m_finalize(m_pParser); }
+
+    void* get() const { return m_pParser; }
+
+private:
+    // Forbidden
+    ParserUse(const ParserUse&);
+    ParserUse& operator =(const ParserUse&);
+
+    void *m_pParser;
+    void (*m_finalize)(void*);
+};
+
+
+namespace
+{
+
+/// Buffers are only split into pieces of at least this size
+const size_t kMinChunkLength = 256 * 1024;
+
+
+/// Feed the tokens of input[start, end) to the context's main grammar
+/// parser, with the given state
+void feedRange(const char* input,
+               size_t start,
+               size_t end,
+               ParserState& state,
+               ContextUse& context)
+{
+    ParserUse parser(context.mainParser(), &ParseFinalize);
+    TokenStream tokens(input, end, start);
+    feedTokens(tokens, kMainGrammar, &Parse, parser.get(), state);
+}
+
+
+/// Parse input[start, end) into root with the context's main grammar parser
+void parseRange(const char* input,
+                size_t start,
+                size_t end,
+                Value& root,
+                const LineIndex& lines,
+                ContextUse& context)
+{
+    // Everything the rules build in between goes back to the arena in one go
+    // when the parse is done
+    ParserState state(root);
+    state.m_pLineIndex = &lines;
+    state.m_pArena = &context.arena();
+    feedRange(input, start, end, state, context);
+}
+
+
+/// Offsets to split a buffer at into about numChunks pieces, each ending
+/// with a top-level value's semicolon (outside any brackets, strings and
+/// comments), starting with 0 and ending with the length.  Gives just those
+/// two if the brackets don't add up.
+std::vector<size_t> findSplitPoints(const char* input, size_t length, size_t numChunks)
+{
+    std::vector<size_t> splits(1, 0);
+    size_t nextSplit = length / numChunks;
+    long depth = 0;
+    for (size_t i = 0; i < length && depth >= 0; ++i)
+    {
+        switch (input[i])
+        {
+        case '"':
+            // Skip the string, escapes and all
+            for (++i; i < length && input[i] != '"'; ++i)
+            {
+                if (input[i] == '\\')
+                {
+                    ++i;
+                }
+            }
+            break;
+        case '/':
+            if (i + 1 < length && input[i + 1] == '/')
+            {
+                while (i < length && input[i] != '\n' && input[i] != '\r')
+                {
+                    ++i;
+                }
+            }
+            break;
+        case '{': case '[': case '(':
+            ++depth;
+            break;
+        case '}': case ']': case ')':
+            if (--depth < 0)
+            {
+                // More closing than opening; leave it all to the parser
+                splits.resize(1);
+            }
+            break;
+        case ';':
+            if (depth == 0 && i + 1 >= nextSplit && i + 1 < length)
+            {
+                splits.push_back(i + 1);
+                nextSplit = std::max(nextSplit + length / numChunks, i + 1);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    splits.push_back(length);
+    return splits;
+}
+
 
-    // Clean up all the tokens we allocated
-    for (size_t i = 0; i < tokens.size(); ++i)
+/// Parse the pieces of a buffer between split points at once, then append
+/// their values to root in order.  Pieces parsed on the calling thread use
+/// the context it already has for the parse.  The first syntax error in the
+/// buffer is thrown, as it would be parsing in one go.  Gives false, leaving
+/// root alone, if a piece failed some other way, so that the caller can parse
+/// the buffer in one go to get the same error that would.
+bool parseChunks(const char* input,
+                 const std::vector<size_t>& splits,
+                 size_t numThreads,
+                 Value& root,
+                 const LineIndex& lines,
+                 ContextUse& callerContext)
+{
+    size_t numChunks = splits.size() - 1;
+    std::vector<Value::Ptr> chunkRoots(numChunks);
+    std::vector<std::exception_ptr> errors(numChunks);
+    const std::thread::id callingThread = std::this_thread::get_id();
+    runInParallel(numThreads, numChunks, [&](size_t i)
+    {
+        try
+        {
+            Value::Ptr pChunkRoot(new Value(Value::kTypeBlock));
+            if (std::this_thread::get_id() == callingThread)
+            {
+                parseRange(input, splits[i], splits[i + 1], *pChunkRoot, lines, callerContext);
+            }
+            else
+            {
+                // Other threads parse with their own default context
+                ContextUse context(NULL);
+                parseRange(input, splits[i], splits[i + 1], *pChunkRoot, lines, context);
+            }
+            chunkRoots[i] = pChunkRoot;
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    });
+
+    // Syntax errors come before anything else, since values are only added
+    // once the whole buffer has been parsed
+    bool otherErrors = false;
+    for (size_t i = 0; i < numChunks; ++i)
+    {
+        if (errors[i])
+        {
+            try
+            {
+                std::rethrow_exception(errors[i]);
+            }
+            catch (ParseException&)
+            {
+                throw;
+            }
+            catch (...)
+            {
+                otherErrors = true;
+            }
+        }
+    }
+    if (otherErrors)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < numChunks; ++i)
     {
-        delete tokens[i];
+        root.appendValues(chunkRoots[i]->names(), chunkRoots[i]->values());
     }
+    return true;
+}
+
 }
 
 
-void Parser::parseReference(const std::string& input, Reference& ref)
+void Parser::parse(const char* input, size_t length, Value& root, LineIndex* pOutLines)
 {
     //
     // Tokenize / parse input into AST
     //
 
-    ParserState state(ref);
-    void *pParser = ReferenceParseAlloc(&(::operator new));
+    ContextUse context(m_pContext);
+
+    // Lines are found in one quick pass up front, rather than being counted
+    // token by token, since only errors and tools asking where a value came
+    // from need them
+    LineIndex& lines = pOutLines ? *pOutLines : context.lines();
+    lines.append(input, length);
+
+    if (m_numThreads > 1 && length >= 2 * kMinChunkLength)
+    {
+        // A few pieces per thread, to even out the work
+        size_t numChunks = std::min(m_numThreads * 4, length / kMinChunkLength);
+        std::vector<size_t> splits = findSplitPoints(input, length, numChunks);
+        if (splits.size() > 2 &&
+            parseChunks(input, splits, m_numThreads, root, lines, context))
+        {
+            return;
+        }
+    }
+
+    parseRange(input, 0, length, root, lines, context);
+}
+
+
+void Parser::parse(std::istream& input, size_t chunkSize, Value& root, LineIndex* pOutLines)
+{
+    //
+    // Tokenize / parse input into AST, one chunk of the stream at a time
+    //
+
+    ContextUse context(m_pContext);
+    LineIndex& lines = pOutLines ? *pOutLines : context.lines();
+
+    ParserState state(root);
+    state.m_pLineIndex = &lines;
+    state.m_pArena = &context.arena();
+    TokenStream tokens(input, chunkSize, lines);
+    ParserUse parser(context.mainParser(), &ParseFinalize);
+    feedTokens(tokens, kMainGrammar, &Parse, parser.get(), state);
+}
+
+
+void Parser::parse(const char* input, size_t length, ParseHandler& handler, LineIndex* pOutLines)
+{
+    //
+    // Tokenize / parse input, reporting what is found to the handler
+    //
+
+    ContextUse context(m_pContext);
+    LineIndex& lines = pOutLines ? *pOutLines : context.lines();
+    lines.append(input, length);
+
+    ParserState state(handler);
+    state.m_pLineIndex = &lines;
+    state.m_pArena = &context.arena();
+    feedRange(input, 0, length, state, context);
+}
+
+
+void Parser::parse(std::istream& input, size_t chunkSize, ParseHandler& handler, LineIndex* pOutLines)
+{
+    //
+    // Tokenize / parse input one chunk of the stream at a time, reporting
+    // what is found to the handler
+    //
+
+    ContextUse context(m_pContext);
+    LineIndex& lines = pOutLines ? *pOutLines : context.lines();
+
+    ParserState state(handler);
+    state.m_pLineIndex = &lines;
+    state.m_pArena = &context.arena();
+    TokenStream tokens(input, chunkSize, lines);
+    ParserUse parser(context.mainParser(), &ParseFinalize);
+    feedTokens(tokens, kMainGrammar, &Parse, parser.get(), state);
+}
+
+
+namespace
+{
+
+inline bool isIdentifierStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+
+/// Longest decimal subscript taken without going through the tokenizer,
+/// which checks bigger ones for overflow
+const size_t kMaxSimpleDigits = 18;
+
+
+/// \brief Parse the common kind of reference in one pass, without the
+/// tokenizer or grammar: identifiers separated by dots, each followed by any
+/// number of decimal integer or plain string subscripts, such as
+/// a.b.c[3]["x"].
+///
+/// Gives false for anything else (whitespace, comments, keywords, escapes,
+/// other kinds of number, nested references or macros, and all errors),
+/// leaving the reference alone for the grammar to parse.  Parts are the same
+/// as the grammar would make, subscripts' offsets included.
+bool parseSimpleReference(const char* input, size_t length, Reference& ref)
+{
+    Reference::PartsList parts;
     size_t index = 0;
-    std::vector<Token*> tokens;
-    while (index < input.length())
+    while (true)
     {
-        tokens.push_back(new Token());
-        Token& token = *tokens.back();
-        try
+        // An identifier, but not a keyword
+        size_t start = index;
+        if (index >= length || !isIdentifierStart(input[index]))
         {
-            index = Token::parseToken(index,
-                                      input,
-                                      token,
-                                      state.m_currentLine,
-                                      state.m_currentPosition);
+            return false;
         }
-        catch (TokenException tokenException)
+        for (++index; index < length && (isIdentifierStart(input[index]) || isDigit(input[index])); ++index) { }
+        size_t identifierLength = index - start;
+        if ((identifierLength == 4 && std::memcmp(input + start, "true", 4) == 0) ||
+            (identifierLength == 5 && std::memcmp(input + start, "false", 5) == 0) ||
+            (identifierLength == 7 && std::memcmp(input + start, "include", 7) == 0))
         {
-            // Rethrow token exceptions as parse errors, with more information
-            throw ParseException(std::string("Syntax error: ") + tokenException.what(),
-                                 state.m_currentSource,
-                                 tokenException.line(),
-                                 tokenException.position());
+            return false;
         }
+        parts.push_back(Reference::Part());
+        parts.back().m_identifier.assign(input + start, identifierLength);
 
-        // Feed tokens to the parser
-        if (token.type() != kTokenWhitespace)
+        // Its subscripts
+        while (index < length && input[index] == '[')
         {
-            ReferenceParse(pParser,
-                           tokenTypeToLemonId(kReferenceGrammar, token.type()),
-                           &token,
-                           &state);
+            start = ++index;
+            Value::Ptr pSubscript;
+            if (index < length && isDigit(input[index]))
+            {
+                long value = 0;
+                for (; index < length && isDigit(input[index]) && index - start < kMaxSimpleDigits; ++index)
+                {
+                    value = value * 10 + (input[index] - '0');
+                }
+                // Leading zeros may mean another base
+                if ((index < length && isDigit(input[index])) ||
+                    (input[start] == '0' && index - start > 1))
+                {
+                    return false;
+                }
+                pSubscript = new Value(value);
+            }
+            else if (index < length && input[index] == '"')
+            {
+                for (++index; index < length && input[index] != '"'; ++index)
+                {
+                    if (input[index] == '\\')
+                    {
+                        return false;
+                    }
+                }
+                if (index >= length)
+                {
+                    return false;
+                }
+                pSubscript = new Value(std::string(input + start + 1, index - start - 1));
+                ++index;
+            }
+            else
+            {
+                return false;
+            }
+            if (index >= length || input[index] != ']')
+            {
+                return false;
+            }
+            ++index;
+            pSubscript->setOffset(start);
+            parts.push_back(Reference::Part());
+            parts.back().m_pSubscriptValue = pSubscript;
         }
+
+        if (index == length)
+        {
+            break;
+        }
+        if (input[index] != '.')
+        {
+            return false;
+        }
+        ++index;
     }
 
-    // Clean up the parser
-    ReferenceParse(pParser, 0, NULL, &state);
-    ReferenceParseFree(pParser, &(::operator delete));
+    ref.parts().swap(parts);
+    return true;
+}
 
-    // Clean up all the tokens we allocated
-    for (size_t i = 0; i < tokens.size(); ++i)
+}
+
+
+void Parser::parseReference(const char* input, size_t length, Reference& ref)
+{
+    //
+    // Tokenize / parse input into AST
+    //
+
+    if (parseSimpleReference(input, length, ref))
     {
-        delete tokens[i];
+        return;
     }
+
+    ContextUse context(m_pContext);
+    context.lines().append(input, length);
+
+    ParserState state(ref);
+    state.m_pLineIndex = &context.lines();
+    state.m_pArena = &context.arena();
+    TokenStream tokens(input, length);
+    ParserUse parser(context.referenceParser(), &ReferenceParseFinalize);
+    feedTokens(tokens, kReferenceGrammar, &ReferenceParse, parser.get(), state);
 }
 
 
@@ -8,6 +8,10 @@
 //
 ////////////
 
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
 #include <Rsd/Reference.h>
 #include <Rsd/Value.h>
 #include <Rsd/Parser.h>
@@ -19,6 +23,82 @@ namespace RenderSpud
     {
 
 
+namespace
+{
+
+/// \brief Recently parsed references, by their text.
+///
+/// Split into shards, each with its own lock, so threads looking up
+/// different strings rarely wait on each other.  Each shard keeps two
+/// generations: lookups find references in either, moving them up into the
+/// current one, and once the current one is full it becomes the previous one
+/// (dropping whatever was there).  So the cache stays bounded, and references
+/// still being asked for survive.
+class ReferenceCache
+{
+public:
+    static ReferenceCache& instance()
+    {
+        static ReferenceCache sCache;
+        return sCache;
+    }
+
+    Reference::ConstPtr find(const std::string& refStr)
+    {
+        Shard& shard = m_shards[std::hash<std::string>()(refStr) % kNumShards];
+        {
+            std::lock_guard<std::mutex> lock(shard.m_mutex);
+            Map::iterator iter = shard.m_current.find(refStr);
+            if (iter != shard.m_current.end())
+            {
+                return iter->second;
+            }
+            iter = shard.m_previous.find(refStr);
+            if (iter != shard.m_previous.end())
+            {
+                Reference::ConstPtr pRef = iter->second;
+                shard.add(refStr, pRef);
+                return pRef;
+            }
+        }
+
+        // Parse outside the lock; if two threads race to parse the same
+        // string, both get a correct reference and the second one is kept
+        Reference::ConstPtr pRef = Reference::fromString(refStr);
+        std::lock_guard<std::mutex> lock(shard.m_mutex);
+        shard.add(refStr, pRef);
+        return pRef;
+    }
+
+private:
+    static const size_t kNumShards = 16;
+    static const size_t kMaxShardEntries = 256;
+
+    typedef std::unordered_map<std::string, Reference::ConstPtr> Map;
+
+    struct Shard
+    {
+        std::mutex m_mutex;
+        Map m_current;
+        Map m_previous;
+
+        void add(const std::string& refStr, const Reference::ConstPtr& pRef)
+        {
+            if (m_current.size() >= kMaxShardEntries)
+            {
+                m_previous.swap(m_current);
+                m_current.clear();
+            }
+            m_current[refStr] = pRef;
+        }
+    };
+
+    Shard m_shards[kNumShards];
+};
+
+}
+
+
 Reference::Reference(const Reference& ref)
     : ReferenceCounted(), m_parts()
 {
@@ -85,5 +165,11 @@ Reference::Ptr Reference::fromString(const std::string& refStr)
 }
 
 
+Reference::ConstPtr Reference::fromStringCached(const std::string& refStr)
+{
+    return ReferenceCache::instance().find(refStr);
+}
+
+
     } // namespace Rsd
 } // namespace RenderSpud
@@ -370,6 +370,11 @@ Schema* SchemaManager::findSchemaForType(const TypeName& type)
 
 bool SchemaManager::loadAllSchemas(const std::string& fileOrDirectoryPath)
 {
+    // Schema files are shared by every manager in the process and rarely
+    // change, so only parse each of them once
+    LoadOptions options;
+    options.m_useIncludeCache = true;
+
 #ifdef _WIN32
     struct _finddata_t info;
     intptr_t pHandle = _findfirst(fileOrDirectoryPath.c_str(), &info);
@@ -389,7 +394,7 @@ bool SchemaManager::loadAllSchemas(const std::string& fileOrDirectoryPath)
                  path.substr(path.length() - 4, 4) == ".RSD"))
             {
                 // Only load files that seem to have '.rsd' extensions
-                File::Ptr pRsdFile = new File(path);
+                File::Ptr pRsdFile = new File(path, options);
                 addSchemas(pRsdFile);
             }
         }
@@ -404,7 +409,7 @@ bool SchemaManager::loadAllSchemas(const std::string& fileOrDirectoryPath)
         if (errno == ENOTDIR)
         {
             // Not a directory?  Must be a file.
-            File::Ptr pRsdFile = new File(fileOrDirectoryPath);
+            File::Ptr pRsdFile = new File(fileOrDirectoryPath, options);
             addSchemas(pRsdFile);
             return true;
         }
@@ -437,7 +442,7 @@ bool SchemaManager::loadAllSchemas(const std::string& fileOrDirectoryPath)
         else if (path.length() > 4 && path.substr(path.length() - 4, 4) == ".rsd")
         {
             // Only load files that seem to have '.rsd' extensions
-            File::Ptr pRsdFile = new File(path);
+            File::Ptr pRsdFile = new File(path, options);
             addSchemas(pRsdFile);
         }
     }
@@ -0,0 +1,157 @@
+////////////
+//
+//  File:      ThreadPool.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Fixed-size worker thread pool used for background loading
+//
+////////////
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "ThreadPool.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+ThreadPool::ThreadPool(size_t numThreads)
+    : m_threads(), m_tasks(), m_mutex(), m_wakeup(), m_stopping(false)
+{
+    if (numThreads == 0)
+    {
+        numThreads = 1;
+    }
+    m_threads.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        m_threads.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    }
+}
+
+
+void ThreadPool::submit(const std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(task);
+    }
+    m_wakeup.notify_one();
+}
+
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_stopping && m_tasks.empty())
+            {
+                m_wakeup.wait(lock);
+            }
+            if (m_tasks.empty())
+                return;
+            task = m_tasks.front();
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+
+namespace
+{
+
+/// Helper threads for runInParallel, shared by every call so that each one
+/// doesn't start and join threads of its own
+ThreadPool& parallelPool()
+{
+    static ThreadPool sPool(std::max<unsigned int>(std::thread::hardware_concurrency(), 2));
+    return sPool;
+}
+
+
+/// What a runInParallel call's threads share.  Helpers hold on to it, since
+/// one may only get to run after the call has returned; by then every task
+/// has been handed out, so it never touches the (gone) task function.
+struct ParallelRun
+{
+    ParallelRun(size_t numTasks, const std::function<void(size_t)>& task)
+        : m_numTasks(numTasks), m_pTask(&task), m_nextTask(0), m_numDone(0), m_mutex(), m_allDone() { }
+
+    /// Run tasks until there are none left to hand out
+    void work()
+    {
+        size_t numRun = 0;
+        for (size_t i = m_nextTask++; i < m_numTasks; i = m_nextTask++)
+        {
+            (*m_pTask)(i);
+            ++numRun;
+        }
+        if (numRun > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_numDone += numRun;
+            if (m_numDone == m_numTasks)
+            {
+                m_allDone.notify_all();
+            }
+        }
+    }
+
+    void waitForAll()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_numDone < m_numTasks)
+        {
+            m_allDone.wait(lock);
+        }
+    }
+
+    const size_t m_numTasks;
+    const std::function<void(size_t)>* m_pTask;
+    std::atomic<size_t> m_nextTask;
+    size_t m_numDone;
+    std::mutex m_mutex;
+    std::condition_variable m_allDone;
+};
+
+}
+
+
+void runInParallel(size_t numThreads, size_t numTasks, const std::function<void(size_t)>& task)
+{
+    std::shared_ptr<ParallelRun> pRun = std::make_shared<ParallelRun>(numTasks, task);
+    for (size_t i = 1; i < numThreads && i < numTasks; ++i)
+    {
+        parallelPool().submit([pRun]() { pRun->work(); });
+    }
+    pRun->work();
+    pRun->waitForAll();
+}
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
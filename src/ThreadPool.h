@@ -0,0 +1,72 @@
+////////////
+//
+//  File:      ThreadPool.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Fixed-size worker thread pool used for background loading
+//
+////////////
+
+#ifndef __RSD_ThreadPool_h__
+#define __RSD_ThreadPool_h__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+/// A fixed set of worker threads pulling tasks off a shared FIFO queue.
+/// Tasks may submit more tasks.  Destroying the pool runs every task still
+/// queued (and any those submit) before the workers exit, so whoever waits on
+/// a task's result is never left hanging.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t numThreads);
+    ~ThreadPool();
+
+    /// Queue a task to be run on one of the worker threads.  While the pool
+    /// is being destroyed, only its own tasks may still submit.
+    void submit(const std::function<void()>& task);
+
+    size_t size() const { return m_threads.size(); }
+
+private:
+    // Forbidden
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator =(const ThreadPool&);
+
+    void workerLoop();
+
+    std::vector<std::thread> m_threads;
+    std::deque< std::function<void()> > m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stopping;
+};
+
+
+/// Run task(0) through task(numTasks - 1) on up to numThreads threads, the
+/// calling one included, handing out the next index to whichever thread is
+/// free; returns once all of them are done.  The other threads come from a
+/// pool kept for the whole process (a thread per core), so calls don't pay
+/// to start threads, and threads keep their thread_local state between
+/// calls.  Tasks must not throw.
+void runInParallel(size_t numThreads, size_t numTasks, const std::function<void(size_t)>& task);
+
+
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_ThreadPool_h__
@@ -0,0 +1,135 @@
+////////////
+//
+//  File:      TokenStream.cpp
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Pull-based stream of tokens over a buffer or an input stream
+//
+////////////
+
+#include <algorithm>
+#include <cstring>
+
+#include "LineIndex.h"
+#include "TokenStream.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+        namespace Parser
+        {
+
+
+TokenStream::TokenStream(const char* input, size_t length, size_t start)
+    : m_numTokens(0), m_offset(start),
+      m_pData(input), m_length(length), m_index(start), m_base(0), m_exhausted(true),
+      m_pInput(NULL), m_chunkSize(0), m_buffer(), m_pLines(NULL)
+{
+
+}
+
+
+TokenStream::TokenStream(std::istream& input, size_t chunkSize, LineIndex& lines)
+    : m_numTokens(0), m_offset(0),
+      m_pData(""), m_length(0), m_index(0), m_base(0), m_exhausted(false),
+      m_pInput(&input), m_chunkSize(chunkSize > 0 ? chunkSize : 1), m_buffer(), m_pLines(&lines)
+{
+    refill();
+}
+
+
+Token* TokenStream::next()
+{
+    while (true)
+    {
+        if (m_index >= m_length)
+        {
+            if (m_exhausted)
+            {
+                m_offset = m_base + m_length;
+                return NULL;
+            }
+            refill();
+            continue;
+        }
+
+        Token& token = m_tokens[m_numTokens % kLiveTokens];
+        size_t nextIndex;
+        try
+        {
+            nextIndex = Token::parseToken(m_index, m_pData, m_length, token);
+        }
+        catch (TokenException& tokenException)
+        {
+            if (m_exhausted)
+            {
+                throw TokenException(m_base + tokenException.offset(), tokenException.what());
+            }
+            // The error may just be the token being cut off by the end of
+            // the window; retry it with more input before reporting it
+            nextIndex = m_length;
+        }
+
+        // A token touching the end of the window might continue past it
+        if (nextIndex >= m_length && !m_exhausted)
+        {
+            refill();
+            continue;
+        }
+        m_index = nextIndex;
+
+        if (token.isWhitespace())
+        {
+            continue;
+        }
+
+        token.setOffset(m_base + token.offset());
+        if (m_pInput && token.textLength() > 0)
+        {
+            std::string& text = m_texts[m_numTokens % kLiveTokens];
+            text.assign(token.text(), token.textLength());
+            token.setText(text.data(), text.length(), token.hasEscapes());
+        }
+        m_offset = m_base + m_index;
+        ++m_numTokens;
+        return &token;
+    }
+}
+
+
+void TokenStream::refill()
+{
+    // Reads at least a chunk, and at least as much as is already held, so a
+    // very long token costs amortized linear time
+    size_t remaining = m_length - m_index;
+    if (remaining > 0 && m_index > 0)
+    {
+        std::memmove(&m_buffer[0], &m_buffer[m_index], remaining);
+    }
+    m_base += m_index;
+    m_index = 0;
+    m_length = remaining;
+
+    size_t readSize = std::max(m_chunkSize, remaining);
+    if (m_buffer.size() < m_length + readSize)
+    {
+        m_buffer.resize(m_length + readSize);
+    }
+    m_pInput->read(&m_buffer[m_length], static_cast<std::streamsize>(readSize));
+    size_t numRead = static_cast<size_t>(m_pInput->gcount());
+    m_pLines->append(&m_buffer[m_length], numRead);
+    m_length += numRead;
+    m_pData = &m_buffer[0];
+    if (numRead < readSize || !m_pInput->good())
+    {
+        m_exhausted = true;
+    }
+}
+
+
+        } // namespace Parser
+    } // namespace Rsd
+} // namespace RenderSpud
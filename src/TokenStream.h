@@ -0,0 +1,98 @@
+////////////
+//
+//  File:      TokenStream.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Pull-based stream of tokens over a buffer or an input stream
+//
+////////////
+
+#ifndef __RSD_TokenStream_h__
+#define __RSD_TokenStream_h__
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "Tokenizer.h"
+
+
+namespace RenderSpud
+{
+    namespace Rsd
+    {
+
+
+class LineIndex;
+
+
+        namespace Parser
+        {
+
+
+/// Hands out the tokens of some input one at a time, skipping whitespace
+/// and comments.  Tokens live in a small ring, so memory use does not grow
+/// with the size of the input: a token handed out by \ref next stays valid
+/// until kLiveTokens more have been pulled.  Anything holding on to a token
+/// for longer (such as a grammar rule with other symbols after it) must copy
+/// out what it needs before then.
+class TokenStream
+{
+public:
+    static const size_t kLiveTokens = 8;
+
+    /// Tokens of a buffer, which must outlive the stream and its tokens,
+    /// starting from offset start (which must not be within a token)
+    TokenStream(const char* input, size_t length, size_t start = 0);
+
+    /// Tokens of an input stream, read in chunks of chunkSize bytes; the
+    /// line starts of what is read are added to lines
+    TokenStream(std::istream& input, size_t chunkSize, LineIndex& lines);
+
+    /// The next token, or NULL at the end of the input.  Tokens and their
+    /// offsets are relative to the whole input.  Throws TokenException on
+    /// bad input.
+    Token* next();
+
+    /// Offset just past the last token handed out (or the end of the input,
+    /// once it has been reached)
+    size_t offset() const { return m_offset; }
+
+private:
+    // Forbidden
+    TokenStream(const TokenStream&);
+    TokenStream& operator =(const TokenStream&);
+
+    /// Drop what has been consumed, and read more of the stream after what
+    /// is left
+    void refill();
+
+    Token m_tokens[kLiveTokens];
+    size_t m_numTokens;
+    size_t m_offset;
+
+    // Current window over the input: the whole buffer, or the unconsumed
+    // part of what has been read from the stream, starting at offset m_base
+    const char* m_pData;
+    size_t m_length;
+    size_t m_index;
+    size_t m_base;
+    bool m_exhausted;
+
+    // Reading from a stream: the window moves when it is refilled, so the
+    // text of each live token is copied next to it
+    std::istream* m_pInput;
+    size_t m_chunkSize;
+    std::vector<char> m_buffer;
+    LineIndex* m_pLines;
+    std::string m_texts[kLiveTokens];
+};
+
+
+        } // namespace Parser
+    } // namespace Rsd
+} // namespace RenderSpud
+
+
+#endif // __RSD_TokenStream_h__
@@ -9,11 +9,22 @@
 ////////////
 
 #include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
 #include <cmath>
+#include <limits>
 #include <map>
 
+#include <Rsd/Platform.h>
+
 #include "Tokenizer.h"
 
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
 
 namespace RenderSpud
 {
@@ -70,6 +81,46 @@ std::string Token::description() const
 }
 
 
+std::string Token::textValue() const
+{
+    if (!m_hasEscapes)
+    {
+        return std::string(m_pText, m_textLength);
+    }
+
+    // Copy the text between escapes a run at a time, decoding each escape
+    std::string value;
+    value.reserve(m_textLength);
+    const char* pText = m_pText;
+    const char* pEnd = m_pText + m_textLength;
+    while (pText < pEnd)
+    {
+        const char* pEscape = static_cast<const char*>(std::memchr(pText, '\\', pEnd - pText));
+        if (!pEscape)
+        {
+            value.append(pText, pEnd - pText);
+            break;
+        }
+        value.append(pText, pEscape - pText);
+        if (pEscape + 1 >= pEnd)
+        {
+            // A trailing backslash has nothing to escape
+            break;
+        }
+        char c = pEscape[1];
+        if (c == 'n')
+            c = '\n';
+        else if (c == 'r')
+            c = '\r';
+        else if (c == 't')
+            c = '\t';
+        value += c;
+        pText = pEscape + 2;
+    }
+    return value;
+}
+
+
 static const char* sTokenMessages[] =
 {
     "unterminated comment",
@@ -77,6 +128,7 @@ static const char* sTokenMessages[] =
     "invalid number literal",
     "invalid binary number literal",
     "invalid octal number literal",
+    "integer literal out of range",
     "invalid token"
 };
 
@@ -88,6 +140,7 @@ enum TokenMessages
     kTokenInvalidNumberLiteral,
     kTokenInvalidBinaryNumberLiteral,
     kTokenInvalidOctalNumberLiteral,
+    kTokenIntegerOutOfRange,
     kTokenInvalidToken
 };
 
@@ -110,24 +163,12 @@ inline bool isDecimalDigit(char c)
 }
 
 
-inline bool isBinaryDigit(char c)
-{
-    return c == '0' || c == '1';
-}
-
-
 inline bool isOctalDigit(char c)
 {
     return c >= '0' && c <= '7';
 }
 
 
-inline bool isHexadecimalDigit(char c)
-{
-    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
-}
-
-
 inline unsigned int charToDecimalInt(char c)
 {
     return static_cast<unsigned int>(c - '0');
@@ -158,423 +199,850 @@ inline unsigned int charToHexadecimalInt(char c)
 }
 
 
-size_t Token::parseToken(size_t startIndex,
-                         const std::string& inputString,
-                         Token& outputToken,
-                         size_t& inOutLineNumber,
-                         size_t& inOutPosition)
-{
-    outputToken.setLine(inOutLineNumber);
-    outputToken.setPos(inOutPosition + 1);
-    size_t lineStartIndex = startIndex - inOutPosition;
-    size_t curIndex = startIndex;
-    char c = inputString[curIndex];
-    if (Parser::isWhitespace(c))
+//
+// Character classes.  Every byte maps to the kind of token it can start, and
+// separately to what it means inside a number literal.
+//
+
+enum CharacterClass
+{
+    kCharInvalid,
+    kCharWhitespace,
+    kCharSlash,
+    kCharQuote,
+    kCharMinus,
+    kCharDigit,
+    kCharDot,
+    kCharIdentifier,
+    // Single-character tokens, in the order of sPunctuationTypes
+    kCharAssign,
+    kCharColon,
+    kCharAt,
+    kCharSemicolon,
+    kCharComma,
+    kCharLeftParen,
+    kCharRightParen,
+    kCharLeftCurlyBracket,
+    kCharRightCurlyBracket,
+    kCharLeftSquareBracket,
+    kCharRightSquareBracket
+};
+
+
+const TokenType sPunctuationTypes[] =
+{
+    kTokenAssign,
+    kTokenColon,
+    kTokenAt,
+    kTokenSemicolon,
+    kTokenComma,
+    kTokenLeftParen,
+    kTokenRightParen,
+    kTokenLeftCurlyBracket,
+    kTokenRightCurlyBracket,
+    kTokenLeftSquareBracket,
+    kTokenRightSquareBracket
+};
+
+
+#define XX kCharInvalid
+#define WS kCharWhitespace
+#define SL kCharSlash
+#define QU kCharQuote
+#define MI kCharMinus
+#define DI kCharDigit
+#define DO kCharDot
+#define ID kCharIdentifier
+#define EQ kCharAssign
+#define CO kCharColon
+#define AT kCharAt
+#define SC kCharSemicolon
+#define CM kCharComma
+#define LP kCharLeftParen
+#define RP kCharRightParen
+#define LC kCharLeftCurlyBracket
+#define RC kCharRightCurlyBracket
+#define LS kCharLeftSquareBracket
+#define RS kCharRightSquareBracket
+
+const unsigned char sCharacterClasses[256] =
+{
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, WS, WS, XX, XX, WS, XX, XX,  // 0x00-0x0f
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0x10-0x1f
+    WS, XX, QU, XX, XX, XX, XX, XX, LP, RP, XX, XX, CM, MI, DO, SL,  //  !"#$%&'()*+,-./
+    DI, DI, DI, DI, DI, DI, DI, DI, DI, DI, CO, SC, XX, EQ, XX, XX,  // 0123456789:;<=>?
+    AT, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  // @ABCDEFGHIJKLMNO
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, LS, XX, RS, XX, ID,  // PQRSTUVWXYZ[\]^_
+    XX, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  // `abcdefghijklmno
+    ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, LC, XX, RC, XX, XX,  // 0x70-0x7f
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0x80-0x8f
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0x90-0x9f
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0xa0-0xaf
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0xb0-0xbf
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0xc0-0xcf
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0xd0-0xdf
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0xe0-0xef
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,  // 0xf0-0xff
+};
+
+#undef XX
+#undef WS
+#undef SL
+#undef QU
+#undef MI
+#undef DI
+#undef DO
+#undef ID
+#undef EQ
+#undef CO
+#undef AT
+#undef SC
+#undef CM
+#undef LP
+#undef RP
+#undef LC
+#undef RC
+#undef LS
+#undef RS
+
+
+enum NumberClass
+{
+    kNumOther,
+    kNumBinaryDigit,    // 0 1
+    kNumOctalDigit,     // 2-7
+    kNumDecimalDigit,   // 8 9
+    kNumHexLetter,      // a-f A-F, except e E
+    kNumExponentLetter, // e E
+    kNumPoint,          // .
+    kNumMinus,          // -
+    kNumNumberClasses
+};
+
+
+#define X kNumOther
+#define B kNumBinaryDigit
+#define O kNumOctalDigit
+#define D kNumDecimalDigit
+#define H kNumHexLetter
+#define E kNumExponentLetter
+#define P kNumPoint
+#define M kNumMinus
+
+const unsigned char sNumberClasses[256] =
+{
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0x00-0x0f
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0x10-0x1f
+    X, X, X, X, X, X, X, X, X, X, X, X, X, M, P, X,  //  !"#$%&'()*+,-./
+    B, B, O, O, O, O, O, O, D, D, X, X, X, X, X, X,  // 0123456789:;<=>?
+    X, H, H, H, H, E, H, X, X, X, X, X, X, X, X, X,  // @ABCDEFGHIJKLMNO
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // PQRSTUVWXYZ[\]^_
+    X, H, H, H, H, E, H, X, X, X, X, X, X, X, X, X,  // `abcdefghijklmno
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0x70-0x7f
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0x80-0x8f
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0x90-0x9f
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0xa0-0xaf
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0xb0-0xbf
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0xc0-0xcf
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0xd0-0xdf
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0xe0-0xef
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,  // 0xf0-0xff
+};
+
+#undef X
+#undef B
+#undef O
+#undef D
+#undef H
+#undef E
+#undef P
+#undef M
+
+
+//
+// Number literal DFA.  Each state says what has been seen so far; each
+// transition either moves to another state (taking the character into the
+// value when kNumTakeDigit is set), finishes the literal before the
+// character, or rejects it.
+//
+
+enum NumberState
+{
+    kNumStart,              // Nothing yet (after any sign)
+    kNumBinary,             // 0b...
+    kNumOctal,              // 0...
+    kNumHex,                // 0x...
+    kNumInteger,            // Decimal digits
+    kNumPointWithoutDigits, // . with no digits before it
+    kNumFraction,           // Digits and a .
+    kNumExponentStart,      // ...e
+    kNumExponentNegative,   // ...e-
+    kNumExponent,           // ...e digits
+    kNumNumberStates,
+
+    // Final transitions
+    kNumDone = kNumNumberStates,
+    kNumInvalid,
+    kNumInvalidBinary,
+    kNumInvalidOctal,
+
+    kNumTakeDigit = 0x80
+};
+
+
+#define DONE kNumDone
+#define BAD  kNumInvalid
+#define BADB kNumInvalidBinary
+#define BADO kNumInvalidOctal
+#define TAKE(state) ((state) | kNumTakeDigit)
+
+const unsigned char sNumberTransitions[kNumNumberStates][kNumNumberClasses] =
+{
+    //                      other  0 1                      2-7                    8 9                    a-f                    e                      .                       -
+    /* start */           { DONE,  TAKE(kNumInteger),       TAKE(kNumInteger),     TAKE(kNumInteger),     DONE,                  BAD,                   kNumPointWithoutDigits, DONE },
+    /* binary */          { DONE,  TAKE(kNumBinary),        BADB,                  BADB,                  DONE,                  BAD,                   BAD,                    DONE },
+    /* octal */           { DONE,  TAKE(kNumOctal),         TAKE(kNumOctal),       BADO,                  DONE,                  BAD,                   BAD,                    DONE },
+    /* hex */             { DONE,  TAKE(kNumHex),           TAKE(kNumHex),         TAKE(kNumHex),         TAKE(kNumHex),         TAKE(kNumHex),         BAD,                    DONE },
+    /* integer */         { DONE,  TAKE(kNumInteger),       TAKE(kNumInteger),     TAKE(kNumInteger),     DONE,                  kNumExponentStart,     kNumFraction,           DONE },
+    /* . */               { DONE,  TAKE(kNumFraction),      TAKE(kNumFraction),    TAKE(kNumFraction),    DONE,                  BAD,                   BAD,                    DONE },
+    /* fraction */        { DONE,  TAKE(kNumFraction),      TAKE(kNumFraction),    TAKE(kNumFraction),    DONE,                  kNumExponentStart,     BAD,                    DONE },
+    /* e */               { DONE,  TAKE(kNumExponent),      TAKE(kNumExponent),    TAKE(kNumExponent),    DONE,                  BAD,                   BAD,                    kNumExponentNegative },
+    /* e- */              { DONE,  TAKE(kNumExponent),      TAKE(kNumExponent),    TAKE(kNumExponent),    DONE,                  BAD,                   BAD,                    DONE },
+    /* exponent */        { DONE,  TAKE(kNumExponent),      TAKE(kNumExponent),    TAKE(kNumExponent),    DONE,                  BAD,                   BAD,                    DONE }
+};
+
+#undef DONE
+#undef BAD
+#undef BADB
+#undef BADO
+#undef TAKE
+
+
+//
+// Scanning kernels.  Each finds the end of a run of some class of characters
+// starting at index, looking at 16 bytes at a time where SSE2 is available
+// and there are 16 bytes left to look at, and a byte at a time otherwise.
+//
+
+/// Index of the lowest set bit (mask must not be zero)
+inline unsigned int lowestSetBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return static_cast<unsigned int>(bit);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+
+#if RS_SSE_SIMD && defined(__SSE2__)
+
+const size_t kScanWidth = 16;
+
+
+inline __m128i loadChunk(const char* input, size_t index)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + index));
+}
+
+
+inline unsigned int equalMask(__m128i chunk, char c)
+{
+    return static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c))));
+}
+
+
+/// Bytes in [low, high]; bytes with the top bit set are never in range
+inline __m128i inRange(__m128i chunk, char low, char high)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(static_cast<char>(low - 1))),
+                         _mm_cmplt_epi8(chunk, _mm_set1_epi8(static_cast<char>(high + 1))));
+}
+
+#endif
+
+
+/// Skip whitespace starting at index (which must be whitespace)
+inline size_t scanWhitespace(const char* input, size_t index, size_t length)
+{
+    // Most runs are a single space between tokens; don't go wide for those
+    if (index + 1 >= length || !Parser::isWhitespace(input[index + 1]))
     {
-        outputToken.setType(kTokenWhitespace);
-        size_t tempStartIndex = startIndex;
-        while (Parser::isWhitespace(c))
-        {
-            if (c == '\r')
-            {
-                ++curIndex;
-                if (curIndex < inputString.length() && inputString[curIndex] != '\n')
-                {
-                    inOutLineNumber++;
-                    inOutPosition = 0;
-                    tempStartIndex = curIndex;
-                }
-            }
-            if (c == '\n')
-            {
-                inOutLineNumber++;
-                inOutPosition = 0;
-                tempStartIndex = curIndex + 1;
-            }
-            curIndex++;
-            if (curIndex < inputString.length())
-                c = inputString[curIndex];
-            else
-                break;
-        }
-        // Fixup position due to potential newlines, and return early
-        inOutPosition += curIndex - tempStartIndex;
-        return curIndex;
+        return index + 1;
     }
-    else if (c == '/')
+#if RS_SSE_SIMD && defined(__SSE2__)
+    while (index + kScanWidth <= length)
     {
-        curIndex++;
-        outputToken.setType(kTokenComment);
-        if (curIndex < inputString.length())
-        {
-            c = inputString[curIndex];
-            if (c != '/')
-            {
-                throw TokenException(inOutLineNumber, inOutPosition,
-                                     sTokenMessages[kTokenUnterminatedComment]);
-            }
-        }
-        else
+        __m128i chunk = loadChunk(input, index);
+        unsigned int whitespace = equalMask(chunk, ' ') | equalMask(chunk, '\t') |
+                                  equalMask(chunk, '\n') | equalMask(chunk, '\r');
+        unsigned int notWhitespace = ~whitespace & 0xffff;
+        if (notWhitespace)
         {
-            throw TokenException(inOutLineNumber, inOutPosition,
-                                 sTokenMessages[kTokenUnterminatedComment]);
+            return index + lowestSetBit(notWhitespace);
         }
+        index += kScanWidth;
+    }
+#endif
+    while (index < length && Parser::isWhitespace(input[index]))
+    {
+        ++index;
+    }
+    return index;
+}
+
 
-        while (c != '\r' && c != '\n')
+/// Find the end of the line (the next '\r' or '\n', or length)
+inline size_t scanToLineEnd(const char* input, size_t index, size_t length)
+{
+#if RS_SSE_SIMD && defined(__SSE2__)
+    while (index + kScanWidth <= length)
+    {
+        __m128i chunk = loadChunk(input, index);
+        unsigned int found = equalMask(chunk, '\n') | equalMask(chunk, '\r');
+        if (found)
         {
-            curIndex++;
-            if (curIndex < inputString.length())
-                c = inputString[curIndex];
-            else
-                break;
+            return index + lowestSetBit(found);
         }
-        outputToken.setTextValue(inputString.substr(startIndex + 1, curIndex - startIndex - 2));
+        index += kScanWidth;
     }
-    else if (c == '=')
+#endif
+    while (index < length && input[index] != '\n' && input[index] != '\r')
     {
-        outputToken.setType(kTokenAssign);
-        curIndex++;
+        ++index;
     }
-    else if (c == ':')
+    return index;
+}
+
+
+/// Find the next '"' or '\\' (or length)
+inline size_t scanToQuoteOrEscape(const char* input, size_t index, size_t length)
+{
+#if RS_SSE_SIMD && defined(__SSE2__)
+    while (index + kScanWidth <= length)
     {
-        outputToken.setType(kTokenColon);
-        curIndex++;
+        __m128i chunk = loadChunk(input, index);
+        unsigned int found = equalMask(chunk, '"') | equalMask(chunk, '\\');
+        if (found)
+        {
+            return index + lowestSetBit(found);
+        }
+        index += kScanWidth;
     }
-    else if (c == '@')
+#endif
+    while (index < length && input[index] != '"' && input[index] != '\\')
     {
-        outputToken.setType(kTokenAt);
-        curIndex++;
+        ++index;
     }
-    else if (c == ';')
+    return index;
+}
+
+
+/// Find the end of a run of identifier characters and digits
+inline size_t scanIdentifier(const char* input, size_t index, size_t length)
+{
+#if RS_SSE_SIMD && defined(__SSE2__)
+    while (index + kScanWidth <= length)
     {
-        curIndex++;
-        outputToken.setType(kTokenSemicolon);
+        __m128i chunk = loadChunk(input, index);
+        __m128i lowered = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        __m128i matches = _mm_or_si128(_mm_or_si128(inRange(lowered, 'a', 'z'),
+                                                    inRange(chunk, '0', '9')),
+                                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+        unsigned int notMatching = ~static_cast<unsigned int>(_mm_movemask_epi8(matches)) & 0xffff;
+        if (notMatching)
+        {
+            return index + lowestSetBit(notMatching);
+        }
+        index += kScanWidth;
     }
-    else if (c == ',')
+#endif
+    while (index < length && (isIdentifierCharacter(input[index]) || isDecimalDigit(input[index])))
     {
-        curIndex++;
-        outputToken.setType(kTokenComma);
+        ++index;
     }
-    else if (c == '.' && (curIndex + 1 < inputString.length() &&
-                          !isDecimalDigit(inputString[curIndex + 1])))
+    return index;
+}
+
+
+/// Find the end of a run of decimal digits starting at index (which must be a
+/// digit)
+inline size_t scanDigits(const char* input, size_t index, size_t length)
+{
+    // Numbers are mostly short; don't go wide for a single digit
+    if (index + 1 >= length || !isDecimalDigit(input[index + 1]))
     {
-        // We encountered a . that isn't directly in front of a number, so it is
-        // supposed to be an accessor
-        curIndex++;
-        outputToken.setType(kTokenDot);
+        return index + 1;
     }
-    else if (c == '(')
+#if RS_SSE_SIMD && defined(__SSE2__)
+    while (index + kScanWidth <= length)
     {
-        curIndex++;
-        outputToken.setType(kTokenLeftParen);
+        __m128i chunk = loadChunk(input, index);
+        unsigned int notDigits = ~static_cast<unsigned int>(_mm_movemask_epi8(inRange(chunk, '0', '9'))) & 0xffff;
+        if (notDigits)
+        {
+            return index + lowestSetBit(notDigits);
+        }
+        index += kScanWidth;
     }
-    else if (c == ')')
+#endif
+    while (index < length && isDecimalDigit(input[index]))
     {
-        curIndex++;
-        outputToken.setType(kTokenRightParen);
+        ++index;
     }
-    else if (c == '{')
+    return index;
+}
+
+
+//
+// Decimal to binary floating point conversion.  Literals are reduced to at
+// most kMaxMantissaDigits significant digits and a power of ten.  When both
+// are small enough to be exact doubles a single multiply or divide rounds
+// correctly (Clinger's fast path).  Otherwise, for powers of ten up to
+// kMaxExactPowerOfFive either way (which covers full-precision values of any
+// everyday size), the value is worked out in 128-bit integers and rounded by
+// hand.  Anything else goes to strtod, which rounds correctly but is much
+// slower.
+//
+
+const size_t kMaxMantissaDigits = 19;
+const unsigned long long kMaxExactMantissa = 1ull << DBL_MANT_DIG;
+const long kMaxExponentDigitsValue = 100000;
+
+const double sExactPowersOfTen[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const long long kMaxExactPowerOfTen = sizeof(sExactPowersOfTen) / sizeof(double) - 1;
+
+
+#if defined(__SIZEOF_INT128__)
+
+typedef unsigned __int128 UInt128;
+
+const long long kMaxExactPowerOfFive = 27;
+
+const unsigned long long sPowersOfFive[kMaxExactPowerOfFive + 1] =
+{
+    1ull, 5ull, 25ull, 125ull, 625ull, 3125ull, 15625ull, 78125ull, 390625ull, 1953125ull,
+    9765625ull, 48828125ull, 244140625ull, 1220703125ull, 6103515625ull, 30517578125ull,
+    152587890625ull, 762939453125ull, 3814697265625ull, 19073486328125ull, 95367431640625ull,
+    476837158203125ull, 2384185791015625ull, 11920928955078125ull, 59604644775390625ull,
+    298023223876953125ull, 1490116119384765625ull, 7450580596923828125ull
+};
+
+
+inline int bitLength(UInt128 value)
+{
+    unsigned long long high = static_cast<unsigned long long>(value >> 64);
+    unsigned long long low = static_cast<unsigned long long>(value);
+    return high ? 128 - __builtin_clzll(high) : (low ? 64 - __builtin_clzll(low) : 0);
+}
+
+
+/// Round value * 2^binaryExponent to the nearest double (ties to even),
+/// where sticky says whether anything nonzero was already dropped below
+/// value.  The result must be a normal double.
+inline double roundToDouble(UInt128 value, bool sticky, int binaryExponent)
+{
+    // Keep the top 64 bits, folding the rest into the sticky bit
+    int shift = bitLength(value) - 64;
+    unsigned long long top;
+    if (shift > 0)
     {
-        curIndex++;
-        outputToken.setType(kTokenLeftCurlyBracket);
+        sticky |= (value & ((static_cast<UInt128>(1) << shift) - 1)) != 0;
+        top = static_cast<unsigned long long>(value >> shift);
     }
-    else if (c == '}')
+    else
     {
-        curIndex++;
-        outputToken.setType(kTokenRightCurlyBracket);
+        top = static_cast<unsigned long long>(value) << -shift;
     }
-    else if (c == '[')
+    binaryExponent += shift;
+
+    // 53 bits of mantissa, and 11 to round with
+    const unsigned long long kHalf = 1ull << 10;
+    unsigned long long mantissa = top >> 11;
+    unsigned long long rest = top & ((1ull << 11) - 1);
+    if (rest > kHalf || (rest == kHalf && (sticky || (mantissa & 1))))
     {
-        curIndex++;
-        outputToken.setType(kTokenLeftSquareBracket);
+        ++mantissa;
     }
-    else if (c == ']')
+    return std::ldexp(static_cast<double>(mantissa), binaryExponent + 11);
+}
+
+
+/// Correctly rounded mantissa * 10^exponent10, for nonzero mantissas and
+/// powers of ten up to kMaxExactPowerOfFive either way
+double decimalToDoubleExact(unsigned long long mantissa, long long exponent10)
+{
+    if (exponent10 >= 0)
     {
-        curIndex++;
-        outputToken.setType(kTokenRightSquareBracket);
+        // mantissa * 5^e * 2^e, and the product fits in 128 bits
+        UInt128 product = static_cast<UInt128>(mantissa) * sPowersOfFive[exponent10];
+        return roundToDouble(product, false, static_cast<int>(exponent10));
     }
-    else if (c == '"')
+
+    // (mantissa * 2^s / 5^e) * 2^-(s + e), shifting up as far as will fit so
+    // the quotient keeps more than enough bits
+    int shift = 128 - bitLength(mantissa);
+    UInt128 dividend = static_cast<UInt128>(mantissa) << shift;
+    unsigned long long divisor = sPowersOfFive[-exponent10];
+    UInt128 quotient = dividend / divisor;
+    bool sticky = dividend % divisor != 0;
+    return roundToDouble(quotient, sticky, -shift + static_cast<int>(exponent10));
+}
+
+#endif
+
+
+/// Correctly rounded value of the digits in input[startIndex, endIndex)
+/// (a '.' among them is skipped, and an exponent after them is ignored)
+/// times 10^exponent10, using strtod
+double decimalToDoubleSlow(const char* input, size_t startIndex, size_t endIndex, long long exponent10)
+{
+    // Give strtod just digits and an exponent, so the locale's idea of a
+    // decimal point doesn't matter
+    std::string digits;
+    digits.reserve(endIndex - startIndex + 24);
+    for (size_t i = startIndex; i < endIndex && input[i] != 'e' && input[i] != 'E'; ++i)
     {
-        curIndex++;
-        outputToken.setType(kTokenString);
-        std::string value;
-        if (curIndex < inputString.length())
+        if (isDecimalDigit(input[i]))
         {
-            c = inputString[curIndex];
+            digits += input[i];
         }
-        else
+    }
+    char exponentText[32];
+    std::snprintf(exponentText, sizeof(exponentText), "e%lld", exponent10);
+    digits += exponentText;
+    return std::strtod(digits.c_str(), NULL);
+}
+
+
+/// Scan a number literal, which starts with a sign, a digit or a '.'
+size_t scanNumber(size_t curIndex,
+                  const char* input,
+                  size_t inputLength,
+                  Token& outputToken)
+{
+    size_t literalStartIndex = curIndex;
+    char c = input[curIndex];
+    bool isNegative = false;
+    if (c == '-')
+    {
+        isNegative = true;
+        curIndex++;
+        if (curIndex >= inputLength)
         {
-            throw TokenException(inOutLineNumber, inOutPosition,
-                                 sTokenMessages[kTokenUnterminatedStringLiteral]);
+            throw TokenException(curIndex - 1, sTokenMessages[kTokenInvalidNumberLiteral]);
         }
+        c = input[curIndex];
+    }
+    size_t digitsStartIndex = curIndex;
+
+    // Decimal literals: the value is mantissa * 10^(exponent +
+    // numDroppedDigits - numFractionDigits), exactly so long as no digits
+    // were dropped
+    unsigned long long mantissa = 0;
+    size_t numMantissaDigits = 0;
+    size_t numDroppedDigits = 0;
+    size_t numFractionDigits = 0;
+    long exponentPart = 0;
+    bool isExponentNegative = false;
 
-        bool escaped = false;
-        while (c != '"' || (c == '"' && escaped))
+    // Binary, octal and hex literals: the bits, which may fill an unsigned long
+    const unsigned long long kMaxBits = std::numeric_limits<unsigned long>::max();
+    unsigned long long bits = 0;
+    bool isOutOfRange = false;
+
+    // A leading zero picks the base from the character after it
+    unsigned int state = kNumStart;
+    if (c == '0')
+    {
+        state = kNumInteger;
+        curIndex++;
+        if (curIndex < inputLength)
         {
-            if (c == '\\' && !escaped)
+            char cn = input[curIndex];
+            if (cn == 'b' || cn == 'B')
             {
-                // Don't add the escape indicator
-                escaped = true;
+                state = kNumBinary;
+                curIndex++;
             }
-            else
+            else if (isOctalDigit(cn))
             {
-                if (escaped)
-                {
-                    if (c == 'n')
-                    {
-                        value += '\n';
-                    }
-                    else if (c == 'r')
-                    {
-                        value += '\r';
-                    }
-                    else if (c == 't')
-                    {
-                        value += '\t';
-                    }
-                    else
-                    {
-                        value += c;
-                    }
-                }
-                else
-                {
-                    value += c;
-                }
-                escaped = false;
-            }
-            curIndex++;
-            if (curIndex < inputString.length())
-            {
-                c = inputString[curIndex];
+                state = kNumOctal;
             }
-            else
+            else if (cn == 'x' || cn == 'X')
             {
-                throw TokenException(inOutLineNumber, inOutPosition,
-                                     sTokenMessages[kTokenUnterminatedStringLiteral]);
+                state = kNumHex;
+                curIndex++;
             }
         }
-        curIndex++;
-        outputToken.setTextValue(value);
     }
-    else if (c == '-' || isDecimalDigit(c) || c == '.')
+
+    while (curIndex < inputLength)
     {
-        bool isNegative;
-        if (c == '-')
+        c = input[curIndex];
+        unsigned int transition = sNumberTransitions[state][sNumberClasses[static_cast<unsigned char>(c)]];
+        if (transition >= kNumDone && !(transition & kNumTakeDigit))
         {
-            isNegative = true;
-            curIndex++;
-            if (curIndex < inputString.length())
+            if (transition == kNumDone)
             {
-                c = inputString[curIndex];
-            }
-            else
-            {
-                throw TokenException(inOutLineNumber, curIndex - lineStartIndex - 1,
-                                     sTokenMessages[kTokenInvalidNumberLiteral]);
+                break;
             }
+            throw TokenException(curIndex,
+                                 sTokenMessages[transition == kNumInvalidBinary ? kTokenInvalidBinaryNumberLiteral :
+                                                transition == kNumInvalidOctal ? kTokenInvalidOctalNumberLiteral :
+                                                                                 kTokenInvalidNumberLiteral]);
         }
-        else
+
+        state = transition & ~kNumTakeDigit;
+        if (!(transition & kNumTakeDigit))
         {
-            isNegative = false;
+            isExponentNegative |= state == kNumExponentNegative;
+            curIndex++;
+            continue;
         }
 
-        long intPart = 0;
-        int exponentPart = 0;
-        double floatPart = 0.0;
-        double floatScale = 1.0;
-
-        bool isHex = false;
-        bool isOct = false;
-        bool isBin = false;
-        bool isFloat = false;
-        bool encounteredDecimal = false;
-        bool encounteredExponent = false;
-        bool encounteredExponentNegative = false;
-        bool encounteredDigit = false;
-
-        size_t numberStartIndex = curIndex;
-
-        bool numberDone = false;
-        while (!numberDone)
+        switch (state)
         {
-            if (c == '0' && curIndex == numberStartIndex)
-            {
-                if (curIndex + 1 < inputString.length())
-                {
-                    char cn = inputString[curIndex + 1];
-                    bool eatNext = false;
-                    if (cn == 'b' || cn == 'B')
-                    {
-                        isBin = true;
-                        eatNext = true;
-                    }
-                    else if (isOctalDigit(cn))
-                    {
-                        isOct = true;
-                        eatNext = false;
-                    }
-                    else if (cn == 'x' || cn == 'X')
-                    {
-                        isHex = true;
-                        eatNext = true;
-                    }
-                    
-                    if (eatNext)
-                    {
-                        ++curIndex;
-                        c = cn;
-                    }
-                }
-                encounteredDigit = true;
-            }
-            else if (c == '.')
-            {
-                if (isOct || isHex || isBin || encounteredExponent || encounteredDecimal)
-                {
-                    throw TokenException(inOutLineNumber, curIndex - lineStartIndex,
-                                         sTokenMessages[kTokenInvalidNumberLiteral]);
-                }
-                isFloat = true;
-                encounteredDecimal = true;
-            }
-            else if ((c == 'e' || c == 'E') && !isHex)
-            {
-                if (!encounteredDigit || encounteredExponent || isHex || isBin || isOct)
-                {
-                    throw TokenException(inOutLineNumber, curIndex - lineStartIndex,
-                                         sTokenMessages[kTokenInvalidNumberLiteral]);
-                }
-                isFloat = true;
-                encounteredExponent = true;
-                encounteredDigit = false;
-            }
-            else if (c == '-' && !isBin && !isOct && !isHex && encounteredExponent && !encounteredExponentNegative && !encounteredDigit)
-            {
-                encounteredExponentNegative = true;
-            }
-            else if (isBin && isDecimalDigit(c))
-            {
-                if (!isBinaryDigit(c))
-                {
-                    throw TokenException(inOutLineNumber, curIndex - lineStartIndex,
-                                         sTokenMessages[kTokenInvalidBinaryNumberLiteral]);
-                }
-                intPart *= 2;
-                intPart += charToBinaryInt(c);
-                encounteredDigit = true;
-            }
-            else if (isOct && isDecimalDigit(c))
+        case kNumBinary:
+            isOutOfRange |= bits > (kMaxBits >> 1);
+            bits = (bits << 1) | charToBinaryInt(c);
+            curIndex++;
+            break;
+        case kNumOctal:
+            isOutOfRange |= bits > (kMaxBits >> 3);
+            bits = (bits << 3) | charToOctalInt(c);
+            curIndex++;
+            break;
+        case kNumHex:
+            isOutOfRange |= bits > (kMaxBits >> 4);
+            bits = (bits << 4) | charToHexadecimalInt(c);
+            curIndex++;
+            break;
+        case kNumExponent:
+        {
+            size_t digitsEndIndex = scanDigits(input, curIndex, inputLength);
+            for (; curIndex < digitsEndIndex; ++curIndex)
             {
-                if (!isOctalDigit(c))
+                // Far past where anything over/underflows; just keep it from
+                // wrapping around
+                if (exponentPart < kMaxExponentDigitsValue)
                 {
-                    throw TokenException(inOutLineNumber, curIndex - lineStartIndex,
-                                         sTokenMessages[kTokenInvalidOctalNumberLiteral]);
+                    exponentPart = exponentPart * 10 + charToDecimalInt(input[curIndex]);
                 }
-                intPart *= 8;
-                intPart += charToOctalInt(c);
-                encounteredDigit = true;
             }
-            else if (isHex && isHexadecimalDigit(c))
+            break;
+        }
+        default:
+        {
+            // Take the whole run of decimal digits at once
+            size_t digitsEndIndex = scanDigits(input, curIndex, inputLength);
+            if (state == kNumFraction)
             {
-                intPart *= 16;
-                intPart += charToHexadecimalInt(c);
-                encounteredDigit = true;
+                numFractionDigits += digitsEndIndex - curIndex;
             }
-            else if (isDecimalDigit(c))
+            for (; curIndex < digitsEndIndex; ++curIndex)
             {
-                if (encounteredExponent)
+                if (numMantissaDigits < kMaxMantissaDigits)
                 {
-                    exponentPart *= 10;
-                    exponentPart += charToDecimalInt(c);
-                }
-                else if (encounteredDecimal)
-                {
-                    floatScale *= 0.1;
-                    floatPart += static_cast<double>(charToDecimalInt(c)) * floatScale;
+                    // Leading zeros don't count towards the digits kept
+                    mantissa = mantissa * 10 + charToDecimalInt(input[curIndex]);
+                    numMantissaDigits += mantissa != 0;
                 }
                 else
                 {
-                    intPart *= 10;
-                    intPart += charToDecimalInt(c);
+                    numDroppedDigits++;
                 }
-                encounteredDigit = true;
-            }
-            else
-            {
-                numberDone = true;
-                break;
             }
+            break;
+        }
+        }
+    }
 
-            curIndex++;
-            if (curIndex < inputString.length())
-            {
-                c = inputString[curIndex];
-            }
+    if (state >= kNumPointWithoutDigits)
+    {
+        long long exponent10 = (isExponentNegative ? -exponentPart : exponentPart) +
+                               static_cast<long long>(numDroppedDigits) -
+                               static_cast<long long>(numFractionDigits);
+        double result;
+        if (mantissa == 0)
+        {
+            result = 0.0;
+        }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+        else if (numDroppedDigits == 0 && mantissa <= kMaxExactMantissa &&
+                 exponent10 >= -kMaxExactPowerOfTen && exponent10 <= kMaxExactPowerOfTen)
+        {
+            // Both operands are exact, so the one rounding is correct
+            result = static_cast<double>(mantissa);
+            if (exponent10 < 0)
+                result /= sExactPowersOfTen[-exponent10];
             else
-            {
-                numberDone = true;
-            }
+                result *= sExactPowersOfTen[exponent10];
         }
-
-        if (isFloat)
+#endif
+#if defined(__SIZEOF_INT128__)
+        else if (numDroppedDigits == 0 &&
+                 exponent10 >= -kMaxExactPowerOfFive && exponent10 <= kMaxExactPowerOfFive)
         {
-            double result = static_cast<double>(intPart);
-            result += floatPart;
-            if (encounteredExponent)
-            {
-                if (encounteredExponentNegative)
-                    exponentPart = -exponentPart;
-                result *= pow(10, exponentPart);
-            }
-            if (isNegative)
-                result = -result;
-            outputToken.setType(kTokenFloat);
-            outputToken.setFloatValue(result);
+            result = decimalToDoubleExact(mantissa, exponent10);
         }
+#endif
         else
         {
-            if (isNegative)
-                intPart = -intPart;
-            outputToken.setType(kTokenInteger);
-            outputToken.setIntegerValue(intPart);
+            result = decimalToDoubleSlow(input, digitsStartIndex, curIndex,
+                                         exponent10 - static_cast<long long>(numDroppedDigits));
         }
+        if (isNegative)
+            result = -result;
+        outputToken.setType(kTokenFloat);
+        outputToken.setFloatValue(result);
     }
-    else if (isIdentifierCharacter(c))
+    else
     {
-        // Must be an identifier or keyword
-        std::string identifier = "";
-        while (isIdentifierCharacter(c) || isDecimalDigit(c))
+        unsigned long magnitude;
+        if (state == kNumInteger || state == kNumStart)
         {
-            identifier += c;
-            curIndex++;
-            if (curIndex < inputString.length())
-                c = inputString[curIndex];
-            else
+            // Decimal literals must fit in a long (down to its minimum)
+            unsigned long long limit = static_cast<unsigned long long>(std::numeric_limits<long>::max()) +
+                                       (isNegative ? 1 : 0);
+            isOutOfRange = numDroppedDigits > 0 || mantissa > limit;
+            magnitude = static_cast<unsigned long>(mantissa);
+        }
+        else
+        {
+            // Other bases give the bits of the long, so may set the sign bit
+            magnitude = static_cast<unsigned long>(bits);
+        }
+        if (isOutOfRange)
+        {
+            throw TokenException(literalStartIndex, sTokenMessages[kTokenIntegerOutOfRange]);
+        }
+        if (isNegative)
+            magnitude = 0ul - magnitude;
+        outputToken.setType(kTokenInteger);
+        outputToken.setIntegerValue(static_cast<long>(magnitude));
+    }
+    return curIndex;
+}
+
+
+size_t Token::parseToken(size_t startIndex,
+                         const char* input,
+                         size_t inputLength,
+                         Token& outputToken)
+{
+    outputToken = Token();
+    outputToken.setOffset(startIndex);
+    size_t curIndex = startIndex;
+    unsigned int charClass = sCharacterClasses[static_cast<unsigned char>(input[curIndex])];
+    switch (charClass)
+    {
+    case kCharWhitespace:
+    {
+        outputToken.setType(kTokenWhitespace);
+        return scanWhitespace(input, curIndex, inputLength);
+    }
+
+    case kCharSlash:
+        curIndex++;
+        outputToken.setType(kTokenComment);
+        if (curIndex >= inputLength || input[curIndex] != '/')
+        {
+            throw TokenException(startIndex, sTokenMessages[kTokenUnterminatedComment]);
+        }
+        curIndex = scanToLineEnd(input, curIndex, inputLength);
+        outputToken.setText(input + startIndex + 2, curIndex - startIndex - 2);
+        break;
+
+    case kCharQuote:
+    {
+        curIndex++;
+        outputToken.setType(kTokenString);
+        size_t textStartIndex = curIndex;
+
+        // Just find the end; escapes are decoded if the text is asked for
+        bool hasEscapes = false;
+        while (true)
+        {
+            curIndex = scanToQuoteOrEscape(input, curIndex, inputLength);
+            if (curIndex >= inputLength)
+            {
+                throw TokenException(startIndex, sTokenMessages[kTokenUnterminatedStringLiteral]);
+            }
+            if (input[curIndex] == '"')
+            {
                 break;
+            }
+            // Skip the escape and whatever it escapes
+            hasEscapes = true;
+            curIndex += 2;
+        }
+        outputToken.setText(input + textStartIndex, curIndex - textStartIndex, hasEscapes);
+        curIndex++;
+        break;
+    }
+
+    case kCharDot:
+        if (curIndex + 1 < inputLength && !isDecimalDigit(input[curIndex + 1]))
+        {
+            // We encountered a . that isn't directly in front of a number, so it is
+            // supposed to be an accessor
+            curIndex++;
+            outputToken.setType(kTokenDot);
+            break;
         }
-        if (identifier == "include")
+        curIndex = scanNumber(curIndex, input, inputLength, outputToken);
+        break;
+
+    case kCharMinus:
+    case kCharDigit:
+        curIndex = scanNumber(curIndex, input, inputLength, outputToken);
+        break;
+
+    case kCharIdentifier:
+    {
+        // Must be an identifier or keyword
+        curIndex = scanIdentifier(input, curIndex, inputLength);
+        const char* identifier = input + startIndex;
+        size_t identifierLength = curIndex - startIndex;
+        if (identifierLength == 7 && std::memcmp(identifier, "include", 7) == 0)
         {
             outputToken.setType(kTokenInclude);
-            outputToken.setTextValue(identifier);
+            outputToken.setText(identifier, identifierLength);
+        }
+        else if (identifierLength == 4 && std::memcmp(identifier, "true", 4) == 0)
+        {
+            outputToken.setType(kTokenBoolean);
+            outputToken.setBooleanValue(true);
         }
-        else if (identifier == "true" || identifier == "false")
+        else if (identifierLength == 5 && std::memcmp(identifier, "false", 5) == 0)
         {
             outputToken.setType(kTokenBoolean);
-            outputToken.setBooleanValue(identifier == "true" ? true : false);
+            outputToken.setBooleanValue(false);
         }
         else
         {
             outputToken.setType(kTokenIdentifier);
-            outputToken.setTextValue(identifier);
+            outputToken.setText(identifier, identifierLength);
         }
+        break;
     }
-    else
-    {
-        throw TokenException(inOutLineNumber, inOutPosition,
-                             sTokenMessages[kTokenInvalidToken]);
+
+    case kCharInvalid:
+        throw TokenException(startIndex, sTokenMessages[kTokenInvalidToken]);
+
+    default:
+        outputToken.setType(sPunctuationTypes[charClass - kCharAssign]);
+        curIndex++;
+        break;
     }
-    inOutPosition += curIndex - startIndex;
     return curIndex;
 }
 
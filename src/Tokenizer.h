@@ -39,22 +39,19 @@ namespace RenderSpud
 class TokenException : public Exception
 {
 public:
-    TokenException(size_t line, size_t pos, const char* pMessage = NULL) throw()
-        : Exception(), m_line(line), m_position(pos), m_pMessage(pMessage) { }
+    TokenException(size_t offset, const char* pMessage = NULL) throw()
+        : Exception(), m_offset(offset), m_pMessage(pMessage) { }
 
     virtual ~TokenException() throw() { }
 
     /// Description of the token error
     virtual const char* what() const throw() { return m_pMessage; }
 
-    /// What line the bad token was found on
-    size_t line()     const throw() { return m_line; }
-    /// What position in the input the bad token was found on
-    size_t position() const throw() { return m_position; }
+    /// Offset into the input the bad token was found at
+    size_t offset() const throw() { return m_offset; }
 
 protected:
-    size_t m_line;
-    size_t m_position;
+    size_t m_offset;
     const char* m_pMessage;
 };
 
@@ -86,29 +83,16 @@ enum TokenType
 };
 
 
-/// Token class, holds only primitive parsed operators and values
+/// Token class, holds only primitive parsed operators and values.  Text
+/// (identifiers, strings, comments) is not copied out of the input: the token
+/// points at it in the input buffer, which must outlive the token, and string
+/// escapes are only decoded when the text is asked for.
 class Token
 {
 public:
-    Token() : m_type(kTokenInvalid), m_boolValue(false), m_intValue(0),
-              m_floatValue(0.0), m_textValue(), m_line(0), m_pos(0) { }
-
-    Token(const Token& t)
-        : m_type(t.m_type), m_boolValue(t.m_boolValue), m_intValue(t.m_intValue),
-          m_floatValue(t.m_floatValue), m_textValue(t.m_textValue),
-          m_line(t.m_line), m_pos(t.m_pos) { }
-
-    Token& operator =(const Token& t)
-    {
-        m_type = t.m_type;
-        m_boolValue = t.m_boolValue;
-        m_intValue = t.m_intValue;
-        m_floatValue = t.m_floatValue;
-        m_textValue = t.m_textValue;
-        m_line = t.m_line;
-        m_pos = t.m_pos;
-        return *this;
-    }
+    Token() : m_type(kTokenInvalid), m_boolValue(false), m_hasEscapes(false),
+              m_intValue(0), m_floatValue(0.0), m_pText(NULL), m_textLength(0),
+              m_offset(0) { }
 
     /// Type of this token
     TokenType type() const         { return m_type; }
@@ -116,7 +100,7 @@ public:
 
     bool isValid()      const { return m_type != kTokenInvalid; }
     bool isWhitespace() const { return m_type == kTokenWhitespace; }
-    bool isComment()    const { return m_type == kTokenWhitespace && m_textValue.length() > 0; }
+    bool isComment()    const { return m_type == kTokenWhitespace && m_textLength > 0; }
     bool isIdentifier() const { return m_type == kTokenIdentifier; }
     bool isString()     const { return m_type == kTokenString; }
     bool isInteger()    const { return m_type == kTokenInteger; }
@@ -126,34 +110,54 @@ public:
     bool   booleanValue() const { return m_boolValue; }
     long   integerValue() const { return m_intValue; }
     double floatValue()   const { return m_floatValue; }
-    /// For identifiers and strings, and comments (whitespace with "text")
-    const std::string& textValue() const { return m_textValue; }
+    /// For identifiers and strings (with escapes decoded), and comments
+    /// (whitespace with "text")
+    std::string textValue() const;
+
+    /// The raw text of the token in the input, escapes and all
+    const char* text()       const { return m_pText; }
+    size_t      textLength() const { return m_textLength; }
+    /// Does the raw text hold escape sequences that \ref textValue decodes?
+    bool        hasEscapes() const { return m_hasEscapes; }
 
     void setBooleanValue(bool v)            { m_boolValue = v; }
     void setIntegerValue(long v)            { m_intValue = v; }
     void setFloatValue(double v)            { m_floatValue = v; }
-    void setTextValue(const std::string& v) { m_textValue = v; }
+    /// Point at raw text in the input
+    void setText(const char* pText, size_t length, bool hasEscapes = false)
+    {
+        m_pText = pText;
+        m_textLength = length;
+        m_hasEscapes = hasEscapes;
+    }
 
-    /// Line this token was encountered
-    size_t line() const { return m_line; }
-    size_t pos()  const { return m_pos; }
-    void setLine(size_t line) { m_line = line; }
-    void setPos(size_t pos)   { m_pos = pos; }
+    /// Offset into the input this token was encountered at (the parser
+    /// works out the line and column from it only when they are needed)
+    size_t offset() const          { return m_offset; }
+    void   setOffset(size_t offset) { m_offset = offset; }
 
 
     /**
-     * Parse a token given an input stream
-     * @param startingIndex Start index in the string where we begin parsing
-     * @param inputString Input string to parse a token from
-     * @param outputToken Token parsed out will be placed in this value
-     * @param inOutLineNumber The current line number; modified to be line number for outputToken
-     * @return Index in the input string just after the token we parsed
+     * Parse a token given an input buffer
+     * @param startingIndex Start index in the buffer where we begin parsing
+     * @param input Input buffer to parse a token from (need not be null-terminated)
+     * @param inputLength Number of bytes available in the input buffer
+     * @param outputToken Token parsed out will be placed in this value; its
+     *        offset is startingIndex
+     * @return Index in the input buffer just after the token we parsed
      */
+    static size_t parseToken(size_t startingIndex,
+                             const char* input,
+                             size_t inputLength,
+                             Token& outputToken);
+
+    /// Convenience for parsing a token out of a string
     static size_t parseToken(size_t startingIndex,
                              const std::string& inputString,
-                             Token& outputToken,
-                             size_t& inOutLineNumber,
-                             size_t& inOutPosNumber);
+                             Token& outputToken)
+    {
+        return parseToken(startingIndex, inputString.data(), inputString.length(), outputToken);
+    }
 
     /// Textual representation of this token
     std::string description() const;
@@ -161,10 +165,12 @@ public:
 private:
     TokenType m_type;
     bool m_boolValue;
+    bool m_hasEscapes;
     long m_intValue;
     double m_floatValue;
-    std::string m_textValue;
-    size_t m_line, m_pos;
+    const char* m_pText;
+    size_t m_textLength;
+    size_t m_offset;
 };
 
 
@@ -10,6 +10,10 @@
 
 #include <sstream>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
 
 #include <Rsd/Value.h>
 #include <Rsd/Parser.h>
@@ -26,8 +30,8 @@ const Value::ConstPtr Value::m_spNull = new Value();
 
 Value::Value()
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeInvalid), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeInvalid), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(), m_string(), m_integer(0)
 {
 
@@ -37,7 +41,7 @@ Value::Value()
 Value::Value(const Value& v)
     : ReferenceCounted(), m_pContext(v.m_pContext),
       m_pInheritedBlock(v.m_pInheritedBlock), m_type(v.m_type),
-      m_typeName(v.m_typeName), m_line(0), m_pos(0), m_fileIndex(kInvalidIndex),
+      m_typeName(v.m_typeName), m_offset(kNoOffset), m_fileIndex(kInvalidIndex), m_hasDeferred(false),
       m_values(), m_blockValueNames(), m_pReference(), m_pMacroInvocation(),
       m_string(), m_integer(0)
 {
@@ -71,7 +75,7 @@ Value::Value(const Value& v)
 
 Value::Value(Type type)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(), m_type(type),
-      m_typeName(), m_line(0), m_pos(0), m_fileIndex(kInvalidIndex), m_values(),
+      m_typeName(), m_offset(kNoOffset), m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(),
       m_blockValueNames(), m_pReference(), m_pMacroInvocation(), m_string(),
       m_integer(0)
 {
@@ -81,8 +85,8 @@ Value::Value(Type type)
 
 Value::Value(bool b)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeBoolean), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeBoolean), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(), m_string(), m_boolean(b)
 {
 
@@ -91,8 +95,8 @@ Value::Value(bool b)
 
 Value::Value(long i)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeInteger), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeInteger), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(), m_string(), m_integer(i)
 {
 
@@ -101,8 +105,8 @@ Value::Value(long i)
 
 Value::Value(double f)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeFloat), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeFloat), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(), m_string(), m_float(f)
 {
 
@@ -111,18 +115,28 @@ Value::Value(double f)
 
 Value::Value(const std::string& s)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeString), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeString), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(), m_string(s), m_integer(0)
 {
 
 }
 
 
+Value::Value(std::string&& s)
+    : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
+      m_type(kTypeString), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
+      m_pReference(), m_pMacroInvocation(), m_string(std::move(s)), m_integer(0)
+{
+
+}
+
+
 Value::Value(MacroInvocation::Ptr pMacroInvocation)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeMacro), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeMacro), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(pMacroInvocation), m_string(),
       m_integer(0)
 {
@@ -132,8 +146,8 @@ Value::Value(MacroInvocation::Ptr pMacroInvocation)
 
 Value::Value(Reference::Ptr pReference)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeReference), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(), m_blockValueNames(),
+      m_type(kTypeReference), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(), m_blockValueNames(),
       m_pReference(pReference), m_pMacroInvocation(), m_string(), m_integer(0)
 {
 
@@ -142,8 +156,18 @@ Value::Value(Reference::Ptr pReference)
 
 Value::Value(ValueArray& arrayValues)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeArray), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(arrayValues), m_blockValueNames(),
+      m_type(kTypeArray), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(arrayValues), m_blockValueNames(),
+      m_pReference(), m_pMacroInvocation(), m_string(), m_integer(0)
+{
+
+}
+
+
+Value::Value(ValueArray&& arrayValues)
+    : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
+      m_type(kTypeArray), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(std::move(arrayValues)), m_blockValueNames(),
       m_pReference(), m_pMacroInvocation(), m_string(), m_integer(0)
 {
 
@@ -152,8 +176,8 @@ Value::Value(ValueArray& arrayValues)
 
 Value::Value(const std::vector<std::string>& names, ValueArray& blockValues)
     : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
-      m_type(kTypeBlock), m_typeName(), m_line(0), m_pos(0),
-      m_fileIndex(kInvalidIndex), m_values(blockValues),
+      m_type(kTypeBlock), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(blockValues),
       m_blockValueNames(names), m_pReference(), m_pMacroInvocation(),
       m_string(), m_integer(0)
 {
@@ -161,8 +185,20 @@ Value::Value(const std::vector<std::string>& names, ValueArray& blockValues)
 }
 
 
+Value::Value(std::vector<std::string>&& names, ValueArray&& blockValues)
+    : ReferenceCounted(), m_pContext(NULL), m_pInheritedBlock(),
+      m_type(kTypeBlock), m_typeName(), m_offset(kNoOffset),
+      m_fileIndex(kInvalidIndex), m_hasDeferred(false), m_values(std::move(blockValues)),
+      m_blockValueNames(std::move(names)), m_pReference(), m_pMacroInvocation(),
+      m_string(), m_integer(0)
+{
+
+}
+
+
 Value::Ptr Value::clone() const
 {
+    loadDeferred();
     return new Value(*this);
 }
 
@@ -203,6 +239,28 @@ void Value::fixupContexts()
 }
 
 
+size_t Value::line() const
+{
+    size_t line, column;
+    if (m_offset == kNoOffset || !locate(m_fileIndex, m_offset, line, column))
+    {
+        return 0;
+    }
+    return line;
+}
+
+
+size_t Value::pos() const
+{
+    size_t line, column;
+    if (m_offset == kNoOffset || !locate(m_fileIndex, m_offset, line, column))
+    {
+        return 0;
+    }
+    return column + 1;
+}
+
+
 bool Value::typeNameMatches(const std::string& typeName)
 {
     return typeNameToString(m_typeName) == typeName;
@@ -618,6 +676,7 @@ Value::Ptr Value::asBlock()
 Value::Ptr Value::asInlinedBlock()
 {
     Value::Ptr pBlock = asBlock();
+    pBlock->loadDeferred();
     Value::Ptr pInlinedBlock = new Value(kTypeBlock);
 
     for (size_t i = 0; i < pBlock->size(); ++i)
@@ -709,18 +768,21 @@ Reference::Ptr Value::asRawReference()
 
 Value::ConstPtr Value::value(size_t i) const
 {
+    loadDeferred();
     return m_values.size() > i ? m_values[i] : NULL;
 }
 
 
 Value::Ptr Value::value(size_t i)
 {
+    loadDeferred();
     return m_values.size() > i ? m_values[i] : NULL;
 }
 
 
 const Value& Value::operator [](size_t i) const
 {
+    loadDeferred();
     if (m_values.size() <= i)
     {
         throw ValueException("Index out of range in Value::operator[](size_t) const");
@@ -731,6 +793,7 @@ const Value& Value::operator [](size_t i) const
 
 Value& Value::operator [](size_t i)
 {
+    loadDeferred();
     if (m_values.size() <= i)
     {
         throw ValueException("Index out of range in Value::operator[](size_t)");
@@ -806,6 +869,7 @@ Value::ConstPtr Value::value(const std::string& name,
                              bool searchIncludes,
                              bool searchInherited) const
 {
+    loadDeferred();
     if (m_type != kTypeBlock)
     {
         throw ValueException("Cannot get named values from non-block values!");
@@ -840,6 +904,7 @@ Value::Ptr Value::value(const std::string& name,
                         bool searchIncludes,
                         bool searchInherited)
 {
+    loadDeferred();
     if (m_type != kTypeBlock)
     {
         throw ValueException("Cannot get named values from non-block values!");
@@ -982,6 +1047,30 @@ void Value::appendValue(const std::string& name, Value::Ptr pValue)
 }
 
 
+void Value::appendValues(const std::vector<std::string>& names, const ValueArray& values)
+{
+    loadDeferred();
+    if (m_type != kTypeBlock)
+    {
+        throw ValueException("Cannot get named values from non-block values!");
+    }
+    std::unordered_set<std::string> present(m_blockValueNames.begin(), m_blockValueNames.end());
+    m_values.reserve(m_values.size() + values.size());
+    m_blockValueNames.reserve(m_blockValueNames.size() + names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if (!present.insert(names[i]).second)
+        {
+            throw ValueException(std::string("Value of name \"") + names[i] +
+                                     "\" already exists in the block!");
+        }
+        m_values.push_back(values[i]);
+        m_blockValueNames.push_back(names[i]);
+        values[i]->setContext(this);
+    }
+}
+
+
 Value::ConstPtr Value::find(const Reference& ref) const
 {
     // Start with what we might refer to
@@ -1106,6 +1195,7 @@ ConstValueArray Value::findByTypeName(const TypeName& typeName,
                                       bool searchIncludes,
                                       bool searchInherited) const
 {
+    loadDeferred();
     ConstValueArray results;
     std::string typeNameStr = typeNameToString(typeName);
     for (size_t i = 0; i < m_values.size(); ++i)
@@ -1142,6 +1232,7 @@ ValueArray Value::findByTypeName(const TypeName& typeName,
                                  bool searchIncludes,
                                  bool searchInherited)
 {
+    loadDeferred();
     ValueArray results;
     std::string typeNameStr = typeNameToString(typeName);
     for (size_t i = 0; i < m_values.size(); ++i)
@@ -1214,7 +1305,16 @@ std::string Value::str(bool followIncludes,
                        size_t indentation) const
 {
     std::ostringstream stream;
+    serialize(stream, followIncludes, keepInline, indentation);
+    return stream.str();
+}
+
 
+void Value::serialize(std::ostream& stream,
+                      bool followIncludes,
+                      bool keepInline,
+                      size_t indentation) const
+{
     if (!m_typeName.empty())
     {
         stream << '@' << typeNameToString(m_typeName) << ' ';
@@ -1229,15 +1329,35 @@ std::string Value::str(bool followIncludes,
     }
     else if (m_type == kTypeInteger)
     {
-        stream << m_integer;
+        // Formatted by hand so the stream's own flags (hex, width, ...) can't
+        // change what gets written
+        char buffer[32];
+        int length = std::snprintf(buffer, sizeof(buffer), "%ld", m_integer);
+        stream.write(buffer, length);
     }
     else if (m_type == kTypeFloat)
     {
-        stream << m_float;
+        // The fewest significant digits (of 15, 16 or 17) that read back as
+        // the very same double, so values survive being written and parsed
+        // again bit for bit
+        char buffer[48];
+        for (int precision = 15; precision <= 17; ++precision)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%.*g", precision, m_float);
+            if (std::strtod(buffer, NULL) == m_float)
+            {
+                break;
+            }
+        }
+        // We don't parse a '+' on an exponent
+        char* pPlus = std::strchr(buffer, '+');
+        if (pPlus)
+        {
+            std::memmove(pPlus, pPlus + 1, std::strlen(pPlus));
+        }
+        stream << buffer;
 
-        double intPart;
-        double fracPart = std::modf(m_float, &intPart);
-        if (fracPart == 0.0)
+        if (!std::strpbrk(buffer, ".eEin"))
         {
             // Ensure float numbers are written out as such, even when they can
             // round exactly to integers otherwise.
@@ -1253,14 +1373,14 @@ std::string Value::str(bool followIncludes,
         stream << "[ ";
         for (size_t i = 0; i < m_values.size(); ++i)
         {
-            stream << m_values[i]->str(followIncludes, true, 0);
+            m_values[i]->serialize(stream, followIncludes, true, 0);
             if (i < m_values.size() - 1)
             {
                 stream << ", ";
             }
             else
             {
-                stream << " ";
+                stream << ' ';
             }
         }
         stream << ']';
@@ -1280,25 +1400,16 @@ std::string Value::str(bool followIncludes,
         {
             if (!keepInline)
             {
-                for (size_t j = 0; j < indentation + 4; ++j)
-                {
-                    stream << ' ';
-                }
+                serializeIndentation(stream, indentation + 4);
             }
             if (!m_values[i]->isInclude())
             {
-                if (Value::isNameStandardFormat(m_blockValueNames[i]))
-                {
-                    stream << m_blockValueNames[i] << " = ";
-                }
-                else
-                {
-                    stream << '"' << m_blockValueNames[i] << "\" = ";
-                }
+                serializeName(stream, m_blockValueNames[i]);
             }
-            stream << m_values[i]->str(followIncludes,
-                                       keepInline,
-                                       indentation + 4);
+            m_values[i]->serialize(stream,
+                                   followIncludes,
+                                   keepInline,
+                                   indentation + 4);
             if (!m_values[i]->isInclude() || !followIncludes)
             {
                 stream << ';';
@@ -1315,10 +1426,7 @@ std::string Value::str(bool followIncludes,
         }
         if (!keepInline)
         {
-            for (size_t i = 0; i < indentation; ++i)
-            {
-                stream << ' ';
-            }
+            serializeIndentation(stream, indentation);
         }
         stream << '}';
     }
@@ -1330,8 +1438,54 @@ std::string Value::str(bool followIncludes,
     {
         stream << m_pReference->str();
     }
+}
 
-    return stream.str();
+
+void Value::serializeName(std::ostream& stream, const std::string& name)
+{
+    if (Value::isNameStandardFormat(name))
+    {
+        stream << name << " = ";
+    }
+    else
+    {
+        stream << '"' << name << "\" = ";
+    }
+}
+
+
+void Value::serializeIndentation(std::ostream& stream, size_t indentation)
+{
+    static const char kSpaces[] = "                                ";
+    const size_t kNumSpaces = sizeof(kSpaces) - 1;
+    while (indentation > 0)
+    {
+        size_t count = indentation < kNumSpaces ? indentation : kNumSpaces;
+        stream.write(kSpaces, static_cast<std::streamsize>(count));
+        indentation -= count;
+    }
+}
+
+
+namespace
+{
+    /// A reference from the cache for a temporary reference value to hold.
+    /// Holding the shared reference is fine, since values don't change their
+    /// references, except that subscripts get their contexts set; references
+    /// with any get a copy of their own.
+    Reference::Ptr referenceToHold(const Reference::ConstPtr& pCached)
+    {
+        for (Reference::PartsList::const_iterator iter = pCached->parts().begin();
+             iter != pCached->parts().end();
+             ++iter)
+        {
+            if (iter->m_pSubscriptValue)
+            {
+                return pCached->clone();
+            }
+        }
+        return Reference::Ptr(const_cast<Reference*>(pCached.get()));
+    }
 }
 
 
@@ -1405,12 +1559,12 @@ Value::ConstResolved Value::resolve(const Value& v) const
                 // Try to parse the reference and resolve it
                 std::string refString = v.m_string.substr(varStart + 2,
                                                           varEnd - varStart - 2);
-                Reference::Ptr pRef = refString.length() > 0 ?
-                    Reference::fromString(refString) :
+                Reference::ConstPtr pRef = refString.length() > 0 ?
+                    Reference::fromStringCached(refString) :
                     NULL;
                 if (pRef != NULL)
                 {
-                    Ptr pTempRefValue = new Value(pRef);
+                    Ptr pTempRefValue = new Value(referenceToHold(pRef));
                     // We're allow the cheat the const system here; once the
                     // context is set on a dependent variable, the value is
                     // const on the way out and shouldn't be changed.
@@ -1572,12 +1726,12 @@ Value::Resolved Value::resolve(Value& v)
                 // Try to parse the reference and resolve it
                 std::string refString = v.m_string.substr(varStart + 2,
                                                           varEnd - varStart - 2);
-                Reference::Ptr pRef = refString.length() > 0 ?
-                    Reference::fromString(refString) :
+                Reference::ConstPtr pRef = refString.length() > 0 ?
+                    Reference::fromStringCached(refString) :
                     NULL;
                 if (pRef != NULL)
                 {
-                    Ptr pTempRefValue = new Value(pRef);
+                    Ptr pTempRefValue = new Value(referenceToHold(pRef));
                     pTempRefValue->setContext(pEvaluationContext);
                     pTempRefValue->fixupContexts();
                     Resolved refResolved = pEvaluationContext->resolve(*pTempRefValue);
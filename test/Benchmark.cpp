@@ -0,0 +1,796 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+
+double secondsSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+double median(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+
+// Write out a scene that looks roughly like what our generators spit out: lots
+// of typed blocks full of numeric arrays, with some strings and references.
+void generateScene(const std::string& filename, size_t numObjects)
+{
+    std::ofstream stream(filename.c_str());
+    stream << "// Generated benchmark scene\n";
+    stream << "globals = @Globals\n{\n    frame = 101;\n    root = \"/shows/bench\";\n};\n\n";
+    for (size_t i = 0; i < numObjects; ++i)
+    {
+        stream << "object" << i << " = @Geometry.Mesh\n{\n";
+        stream << "    file = \"${globals.root}/assets/object" << i << ".geo\";\n";
+        stream << "    visible = " << ((i % 3) ? "true" : "false") << ";\n";
+        stream << "    id = " << i << ";\n";
+        stream << "    transform = @M44f [ ";
+        for (size_t j = 0; j < 16; ++j)
+        {
+            stream << (j % 5 == 0 ? 1.0 : 0.0) + 0.001 * static_cast<double>(i + j);
+            stream << (j < 15 ? ", " : " ];\n");
+        }
+        stream << "    points = [ ";
+        for (size_t j = 0; j < 48; ++j)
+        {
+            stream << 0.25 * static_cast<double>(j) - 3.5 << ", " << static_cast<long>(j * 7 + i);
+            stream << (j < 47 ? ", " : " ];\n");
+        }
+        stream << "    material = materials.default;\n";
+        stream << "    attributes = { shader = \"plastic\"; roughness = 0.35; samples = [1, 2, 4, 8]; };\n";
+        stream << "};\n\n";
+    }
+    stream << "materials = { default = { color = [0.18, 0.18, 0.18]; }; };\n";
+}
+
+
+// Write out a scene that is mostly text rather than numbers: deep
+// indentation, long attribute names, asset paths and comments.
+void generateTextScene(const std::string& filename, size_t numAttributes)
+{
+    std::ofstream stream(filename.c_str());
+    stream << "// Generated text-heavy benchmark scene\n";
+    stream << "assets = @AssetList\n{\n";
+    for (size_t i = 0; i < numAttributes; ++i)
+    {
+        stream << "        shadingNetworkParameter" << i << "_displacementBoundSpace = "
+               << "\"/shows/bench/sequences/sq" << i % 50 << "/shots/sh" << i
+               << "/assets/characterHeroGeometry.abc\";    // from asset library " << i % 7 << "\n";
+    }
+    stream << "};\n";
+}
+
+
+// Write out nothing but big arrays of full-precision floats and integers,
+// like baked transforms and point caches.
+void generateNumericScene(const std::string& filename, size_t numArrays)
+{
+    std::ofstream stream(filename.c_str());
+    stream << std::setprecision(17);
+    unsigned long long state = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < numArrays; ++i)
+    {
+        stream << "xform" << i << " = @M44f [ ";
+        for (size_t j = 0; j < 16; ++j)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            stream << static_cast<double>(state >> 11) / 9007199254740992.0 * 200.0 - 100.0
+                   << (j < 15 ? ", " : " ];\n");
+        }
+        stream << "ids" << i << " = [ ";
+        for (size_t j = 0; j < 16; ++j)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            stream << static_cast<long>(state >> 34) << (j < 15 ? ", " : " ];\n");
+        }
+    }
+}
+
+
+// Split a scene across a root file that includes one file per group of
+// objects, the way shot files pull in asset and light-rig includes.
+void generateIncludeScene(const std::string& rootFilename, size_t numIncludes, size_t objectsPerInclude)
+{
+    std::ofstream root(rootFilename.c_str());
+    for (size_t i = 0; i < numIncludes; ++i)
+    {
+        std::ostringstream includeName;
+        includeName << rootFilename << ".part" << i << ".rsd";
+        generateScene(includeName.str(), objectsPerInclude);
+        std::string relativeName = includeName.str();
+        size_t lastSlash = relativeName.rfind('/');
+        if (lastSlash != std::string::npos)
+            relativeName = relativeName.substr(lastSlash + 1);
+        root << "include \"" << relativeName << "\";\n";
+    }
+}
+
+
+void removeIncludeScene(const std::string& rootFilename, size_t numIncludes)
+{
+    for (size_t i = 0; i < numIncludes; ++i)
+    {
+        std::ostringstream includeName;
+        includeName << rootFilename << ".part" << i << ".rsd";
+        std::remove(includeName.str().c_str());
+    }
+    std::remove(rootFilename.c_str());
+}
+
+
+// Try to get the file's pages out of the page cache so the next load is cold
+void dropFromPageCache(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    ::fdatasync(fd);
+#ifdef POSIX_FADV_DONTNEED
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    ::close(fd);
+}
+
+
+// The previous load path: a getline loop into a string, then a File over that
+File::FilePtr loadWithGetline(const std::string& filename)
+{
+    std::string inputBuffer;
+    std::ifstream inputStream(filename.c_str());
+    while (inputStream.good() && !inputStream.eof())
+    {
+        std::string inputLine;
+        getline(inputStream, inputLine);
+        inputBuffer += inputLine + '\n';
+    }
+    return new File(inputBuffer, filename);
+}
+
+
+File::FilePtr loadWithMapping(const std::string& filename)
+{
+    return new File(filename);
+}
+
+
+// Time a single load in a forked child, so every measurement starts from a
+// fresh heap rather than one fragmented by the trees built before it.
+double timeLoadIsolated(const std::string& filename,
+                        File::FilePtr (*loader)(const std::string&))
+{
+    int fds[2];
+    if (::pipe(fds) != 0)
+        return -1.0;
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        ::close(fds[0]);
+        Clock::time_point start = Clock::now();
+        File::FilePtr pFile = loader(filename);
+        double elapsed = secondsSince(start);
+        ssize_t written = ::write(fds[1], &elapsed, sizeof(elapsed));
+        ::_exit(written == sizeof(elapsed) ? 0 : 1);
+    }
+    ::close(fds[1]);
+    double elapsed = -1.0;
+    if (pid < 0 || ::read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+        elapsed = -1.0;
+    ::close(fds[0]);
+    if (pid > 0)
+        ::waitpid(pid, NULL, 0);
+    return elapsed;
+}
+
+
+void reportLoad(const std::string& label,
+                const std::string& filename,
+                File::FilePtr (*loader)(const std::string&),
+                size_t iterations)
+{
+    std::vector<double> coldTimes, warmTimes;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        dropFromPageCache(filename);
+        coldTimes.push_back(timeLoadIsolated(filename, loader));
+        warmTimes.push_back(timeLoadIsolated(filename, loader));
+    }
+    std::cout << "  " << std::left << std::setw(12) << label << std::right
+              << "  cold " << std::fixed << std::setprecision(4) << median(coldTimes) << " s"
+              << "  warm " << median(warmTimes) << " s" << std::endl;
+}
+
+
+void benchmarkLoad(const std::string& filename, size_t iterations)
+{
+    std::cout << "load: " << filename << std::endl;
+    reportLoad("getline", filename, &loadWithGetline, iterations);
+    reportLoad("mmap", filename, &loadWithMapping, iterations);
+}
+
+
+File::FilePtr loadStreamBuffered(const std::string& filename)
+{
+    std::ifstream inputStream(filename.c_str());
+    return new File(inputStream, filename);
+}
+
+
+File::FilePtr loadStreamChunked(const std::string& filename)
+{
+    std::ifstream inputStream(filename.c_str());
+    LoadOptions options;
+    options.m_streamChunkSize = 64 * 1024;
+    return new File(inputStream, filename, ".", options);
+}
+
+
+void benchmarkStream(const std::string& filename, size_t iterations)
+{
+    std::cout << "stream: " << filename << std::endl;
+    reportLoad("buffered", filename, &loadStreamBuffered, iterations);
+    reportLoad("chunked", filename, &loadStreamChunked, iterations);
+}
+
+
+size_t sIncludeThreads = 0;
+bool sLazyIncludes = false;
+
+File::FilePtr loadWithIncludeThreads(const std::string& filename)
+{
+    LoadOptions options;
+    options.m_includeThreads = sIncludeThreads;
+    return new File(filename, options);
+}
+
+
+void benchmarkIncludes(size_t iterations)
+{
+    const size_t kNumIncludes = 32;
+    std::string filename = "benchmarkIncludes.rsd";
+    generateIncludeScene(filename, kNumIncludes, 150);
+
+    size_t numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 2);
+    std::cout << "includes: " << kNumIncludes << " includes, " << numThreads << " threads" << std::endl;
+    sIncludeThreads = 0;
+    reportLoad("serial", filename, &loadWithIncludeThreads, iterations);
+    sIncludeThreads = numThreads;
+    reportLoad("parallel", filename, &loadWithIncludeThreads, iterations);
+
+    removeIncludeScene(filename, kNumIncludes);
+}
+
+
+File::FilePtr loadAndLookUpOne(const std::string& filename)
+{
+    LoadOptions options;
+    options.m_lazyIncludes = sLazyIncludes;
+    File::FilePtr pFile = new File(filename, options);
+    pFile->Value::find(std::string("object0.id"));
+    return pFile;
+}
+
+
+// A render that only needs a little of a big scene; lazily opened includes
+// are only read once a lookup reaches them
+void benchmarkLazy(size_t iterations)
+{
+    const size_t kNumIncludes = 32;
+    std::string filename = "benchmarkLazy.rsd";
+    generateIncludeScene(filename, kNumIncludes, 150);
+
+    std::cout << "lazy: " << kNumIncludes << " includes, one lookup" << std::endl;
+    sLazyIncludes = false;
+    reportLoad("eager", filename, &loadAndLookUpOne, iterations);
+    sLazyIncludes = true;
+    reportLoad("lazy", filename, &loadAndLookUpOne, iterations);
+
+    removeIncludeScene(filename, kNumIncludes);
+}
+
+
+double timeParseInMemory(const std::string& filename,
+                         size_t iterations,
+                         size_t parseThreads = 0)
+{
+    std::ifstream stream(filename.c_str());
+    std::stringstream contents;
+    contents << stream.rdbuf();
+    std::string text = contents.str();
+
+    std::vector<double> times;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        Clock::time_point start = Clock::now();
+        LoadOptions options(false);
+        options.m_parseThreads = parseThreads;
+        File::FilePtr pFile = new File(text, filename, ".", options);
+        times.push_back(secondsSince(start));
+    }
+    return static_cast<double>(text.length()) / median(times) / (1024.0 * 1024.0);
+}
+
+
+// Tokenizing and parsing alone, with the file already in memory
+void benchmarkParse(const std::string& filename, size_t iterations)
+{
+    std::string textFilename = "benchmarkText.rsd";
+    generateTextScene(textFilename, 100000);
+
+    std::cout << "parse: in memory" << std::endl;
+    std::cout << "  numeric       " << std::fixed << std::setprecision(1)
+              << timeParseInMemory(filename, iterations) << " MB/s" << std::endl;
+    std::cout << "  text          " << timeParseInMemory(textFilename, iterations) << " MB/s" << std::endl;
+
+    std::remove(textFilename.c_str());
+}
+
+
+// A structural index built up front (a 16-byte scan for where every token
+// starts, then feeding the grammar from it) was tried for these arrays and
+// dropped: at -O3 it parsed 27.6 MB/s here against the tokenizer's 28.8, and
+// 15.0 against 16.0 on the generated scene, since the tokenizer already scans
+// runs 16 bytes at a time
+void benchmarkNumbers(size_t iterations)
+{
+    std::string numericFilename = "benchmarkNumeric.rsd";
+    generateNumericScene(numericFilename, 10000);
+
+    std::cout << "numbers: full-precision float and integer arrays, in memory" << std::endl;
+    std::cout << "  parse         " << std::fixed << std::setprecision(1)
+              << timeParseInMemory(numericFilename, iterations) << " MB/s" << std::endl;
+
+    std::remove(numericFilename.c_str());
+}
+
+
+// Texture paths built from ${...} references to other values, which are the
+// same few references over and over
+void benchmarkInterpolate(size_t iterations)
+{
+    const size_t kNumPaths = 100000;
+    std::ostringstream text;
+    text << "shot = { root = \"/shows/demo/sh010\"; }; frame = 1001;\ntextures = [\n";
+    for (size_t i = 0; i < kNumPaths; ++i)
+    {
+        text << "    \"${shot.root}/tex/t" << i << ".${frame}.exr\",\n";
+    }
+    text << "    \"\"\n];\n";
+    File::FilePtr pFile = new File(text.str(), "benchmarkInterpolate.rsd", ".", LoadOptions(false));
+    Value::Ptr pTextures = pFile->value("textures");
+
+    std::vector<double> resolveTimes, parseTimes, cachedTimes;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        Clock::time_point start = Clock::now();
+        size_t length = 0;
+        for (size_t j = 0; j < pTextures->size(); ++j)
+        {
+            length += pTextures->values()[j]->asString().length();
+        }
+        resolveTimes.push_back(secondsSince(start));
+
+        start = Clock::now();
+        for (size_t j = 0; j < kNumPaths; ++j)
+        {
+            length += Reference::fromString("shot.root")->parts().size();
+        }
+        parseTimes.push_back(secondsSince(start));
+
+        start = Clock::now();
+        for (size_t j = 0; j < kNumPaths; ++j)
+        {
+            length += Reference::fromStringCached("shot.root")->parts().size();
+        }
+        cachedTimes.push_back(secondsSince(start));
+        if (length == 0)
+        {
+            std::cout << "(nothing resolved)" << std::endl;
+        }
+    }
+
+    std::cout << "interpolate: " << kNumPaths << " strings with two ${...} each" << std::endl;
+    std::cout << "  resolve       " << std::fixed << std::setprecision(3) << median(resolveTimes) << " s" << std::endl;
+    std::cout << "  shot.root     parsed " << median(parseTimes) << " s"
+              << "  cached " << median(cachedTimes) << " s" << std::endl;
+}
+
+
+// Nanoseconds per Reference::fromString of some text
+double timeFromString(const std::string& text, size_t iterations)
+{
+    const size_t kNumParses = 100000;
+    std::vector<double> times;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        Clock::time_point start = Clock::now();
+        size_t numParts = 0;
+        for (size_t j = 0; j < kNumParses; ++j)
+        {
+            numParts += Reference::fromString(text)->parts().size();
+        }
+        times.push_back(secondsSince(start));
+        if (numParts == 0)
+        {
+            std::cout << "(nothing parsed)" << std::endl;
+        }
+    }
+    return median(times) * 1.0e9 / kNumParses;
+}
+
+
+// Plain references parsed directly, or (with a trailing space, or a nested
+// reference) by the tokenizer and grammar
+void benchmarkReferences(size_t iterations)
+{
+    std::cout << "references: Reference::fromString" << std::endl;
+    std::cout << "  shot.root     " << std::fixed << std::setprecision(0)
+              << timeFromString("shot.root", iterations) << " ns"
+              << "  grammar " << timeFromString("shot.root ", iterations) << " ns" << std::endl;
+    std::cout << "  a.b.c[3][\"x\"] "
+              << timeFromString("a.b.c[3][\"x\"]", iterations) << " ns"
+              << "  grammar " << timeFromString("a.b.c[3][\"x\"] ", iterations) << " ns" << std::endl;
+    std::cout << "  a[b.c]        "
+              << timeFromString("a[b.c]", iterations) << " ns" << std::endl;
+}
+
+
+// One big file parsed on one thread, or split between several
+void benchmarkParallel(const std::string& filename, size_t iterations)
+{
+    std::cout << "parallel: one file on several threads, in memory" << std::endl;
+    std::cout << "  1 thread      " << std::fixed << std::setprecision(1)
+              << timeParseInMemory(filename, iterations) << " MB/s" << std::endl;
+    for (size_t numThreads = 2; numThreads <= 8; numThreads *= 2)
+    {
+        std::cout << "  " << numThreads << " threads     "
+                  << timeParseInMemory(filename, iterations, numThreads) << " MB/s" << std::endl;
+    }
+}
+
+
+// Collects every geometry block's file path, the way scene scanners do
+class GeometryFilesHandler : public Parser::ParseHandler
+{
+public:
+    GeometryFilesHandler() : m_files(), m_depth(0), m_geometryDepth(0), m_name(), m_isGeometry(false) { }
+
+    virtual void name(const std::string& name)      { m_name = name; }
+    virtual void typeName(const TypeName& typeName) { m_isGeometry = !typeName.empty() && typeName[0] == "Geometry"; }
+
+    virtual void beginBlock(const Reference* pInheritFrom, size_t offset)
+    {
+        ++m_depth;
+        if (m_isGeometry)
+        {
+            m_geometryDepth = m_depth;
+        }
+        m_isGeometry = false;
+    }
+    virtual void endBlock()
+    {
+        if (m_geometryDepth == m_depth)
+        {
+            m_geometryDepth = 0;
+        }
+        --m_depth;
+    }
+
+    virtual void stringValue(const std::string& value, size_t offset)
+    {
+        if (m_geometryDepth == m_depth && m_name == "file")
+        {
+            m_files.push_back(value);
+        }
+        m_isGeometry = false;
+    }
+
+    std::vector<std::string> m_files;
+
+private:
+    size_t m_depth;
+    size_t m_geometryDepth;
+    std::string m_name;
+    bool m_isGeometry;
+};
+
+
+// MB/s parsing text into values, or telling a handler about it
+double timeParseHandler(const std::string& text, size_t iterations, Parser::ParseHandler* pHandler)
+{
+    std::vector<double> times;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        Clock::time_point start = Clock::now();
+        Parser::Parser parser;
+        if (pHandler)
+        {
+            parser.parse(text, *pHandler);
+        }
+        else
+        {
+            Value::Ptr pRoot(new Value(Value::kTypeBlock));
+            parser.parse(text, *pRoot);
+        }
+        times.push_back(secondsSince(start));
+    }
+    return static_cast<double>(text.length()) / median(times) / (1024.0 * 1024.0);
+}
+
+
+// Scanning a scene with events, rather than building its values
+void benchmarkEvents(const std::string& filename, size_t iterations)
+{
+    std::ifstream stream(filename.c_str());
+    std::stringstream contents;
+    contents << stream.rdbuf();
+    std::string text = contents.str();
+
+    Parser::ParseHandler nothingHandler;
+    GeometryFilesHandler geometryHandler;
+    std::cout << "events: values vs a handler, in memory" << std::endl;
+    std::cout << "  values        " << std::fixed << std::setprecision(1)
+              << timeParseHandler(text, iterations, NULL) << " MB/s" << std::endl;
+    std::cout << "  no handling   " << timeParseHandler(text, iterations, &nothingHandler) << " MB/s" << std::endl;
+    std::cout << "  geometry      "
+              << timeParseHandler(text, iterations, &geometryHandler) << " MB/s" << std::endl;
+}
+
+
+void benchmarkBinary(const std::string& filename, size_t iterations)
+{
+    std::string binaryFilename = filename + "b";
+    File::FilePtr pFile = new File(filename, LoadOptions(false));
+    pFile->writeBinary(binaryFilename);
+    pFile = NULL;
+
+    std::cout << "binary: " << filename << " vs " << binaryFilename << std::endl;
+    reportLoad("text", filename, &loadWithMapping, iterations);
+    reportLoad("binary", binaryFilename, &loadWithMapping, iterations);
+
+    std::remove(binaryFilename.c_str());
+}
+
+
+double timeWrite(const File::FilePtr& pFile, const std::string& outFilename, bool viaString)
+{
+    Clock::time_point start = Clock::now();
+    if (viaString)
+    {
+        // The previous write path: build the whole text as a string first
+        std::ofstream stream(outFilename.c_str());
+        stream << pFile->str(true);
+    }
+    else
+    {
+        pFile->write(outFilename, true);
+    }
+    return secondsSince(start);
+}
+
+
+void benchmarkWrite(const std::string& filename, size_t iterations)
+{
+    std::string outFilename = filename + ".out";
+    File::FilePtr pFile = new File(filename);
+    std::vector<double> stringTimes, streamTimes;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        stringTimes.push_back(timeWrite(pFile, outFilename, true));
+        streamTimes.push_back(timeWrite(pFile, outFilename, false));
+    }
+    std::cout << "write: " << filename << std::endl;
+    std::cout << "  via str()     " << std::fixed << std::setprecision(4)
+              << median(stringTimes) << " s" << std::endl;
+    std::cout << "  streamed      " << median(streamTimes) << " s" << std::endl;
+    std::remove(outFilename.c_str());
+}
+
+
+// Shipping a shot: load a scene of many includes from its files, or from a
+// bundle of all of them
+void benchmarkBundle(size_t iterations)
+{
+    const size_t kNumIncludes = 32;
+    std::string filename = "benchmarkBundle.rsd";
+    std::string bundleFilename = "benchmarkBundle.rsda";
+    generateIncludeScene(filename, kNumIncludes, 150);
+    File::writeBundle(filename, bundleFilename);
+
+    std::cout << "bundle: " << kNumIncludes << " includes" << std::endl;
+    reportLoad("files", filename, &loadWithMapping, iterations);
+    reportLoad("bundle", bundleFilename, &loadWithMapping, iterations);
+
+    removeIncludeScene(filename, kNumIncludes);
+    std::remove(bundleFilename.c_str());
+}
+
+
+// Renderer startup: load the scene while doing other setup work (stood in for
+// by a fixed sleep), either one after the other or with the load in the
+// background
+void benchmarkAsync(const std::string& filename, size_t iterations)
+{
+    const std::chrono::milliseconds kOtherSetup(200);
+    std::vector<double> serialTimes, asyncTimes;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        Clock::time_point start = Clock::now();
+        File::FilePtr pFile = new File(filename);
+        std::this_thread::sleep_for(kOtherSetup);
+        serialTimes.push_back(secondsSince(start));
+
+        start = Clock::now();
+        FileLoad load = File::loadAsync(filename);
+        std::this_thread::sleep_for(kOtherSetup);
+        pFile = load.get();
+        asyncTimes.push_back(secondsSince(start));
+    }
+    std::cout << "async: " << filename << " plus " << kOtherSetup.count() << " ms of other setup" << std::endl;
+    std::cout << "  serial        " << std::fixed << std::setprecision(4)
+              << median(serialTimes) << " s" << std::endl;
+    std::cout << "  loadAsync     " << median(asyncTimes) << " s" << std::endl;
+}
+
+
+// An interactive session editing one light-rig include of a big scene: load
+// everything again, or reload just the edited file
+void benchmarkReload(size_t iterations)
+{
+    const size_t kNumIncludes = 32;
+    std::string filename = "benchmarkReload.rsd";
+    generateIncludeScene(filename, kNumIncludes, 150);
+    std::string editedFilename = filename + ".part0.rsd";
+
+    File::FilePtr pFile = new File(filename);
+    std::vector<double> fullTimes, reloadTimes;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        generateScene(editedFilename, 150 + (i % 2));
+        Clock::time_point start = Clock::now();
+        File::FilePtr pReopened = new File(filename);
+        fullTimes.push_back(secondsSince(start));
+
+        start = Clock::now();
+        pFile->reload();
+        reloadTimes.push_back(secondsSince(start));
+    }
+    std::cout << "reload: " << kNumIncludes << " includes, one edited" << std::endl;
+    std::cout << "  full load     " << std::fixed << std::setprecision(4)
+              << median(fullTimes) << " s" << std::endl;
+    std::cout << "  reload()      " << median(reloadTimes) << " s" << std::endl;
+
+    removeIncludeScene(filename, kNumIncludes);
+}
+
+
+// Repeatedly open the same scene in one process, as tools that open many
+// scene files sharing includes do; the cache only helps after the first load
+double timeRepeatedLoads(const std::string& filename, bool useIncludeCache, size_t iterations)
+{
+    LoadOptions options;
+    options.m_useIncludeCache = useIncludeCache;
+    std::vector<double> times;
+    for (size_t i = 0; i < iterations + 1; ++i)
+    {
+        Clock::time_point start = Clock::now();
+        File::FilePtr pFile = new File(filename, options);
+        if (i > 0)
+            times.push_back(secondsSince(start));
+    }
+    return median(times);
+}
+
+
+void benchmarkCache(size_t iterations)
+{
+    const size_t kNumIncludes = 32;
+    std::string filename = "benchmarkCache.rsd";
+    generateIncludeScene(filename, kNumIncludes, 50);
+
+    std::cout << "cache: " << kNumIncludes << " includes, repeated loads" << std::endl;
+    std::cout << "  uncached      " << std::fixed << std::setprecision(4)
+              << timeRepeatedLoads(filename, false, iterations) << " s" << std::endl;
+    std::cout << "  cached        " << timeRepeatedLoads(filename, true, iterations) << " s" << std::endl;
+
+    removeIncludeScene(filename, kNumIncludes);
+}
+
+}
+
+
+int main(int argc, char **argv)
+{
+    std::string section = argc > 1 ? argv[1] : "all";
+    std::string filename = argc > 2 ? argv[2] : "";
+    size_t iterations = argc > 3 ? static_cast<size_t>(std::atoi(argv[3])) : 5;
+    bool generated = false;
+
+    if (filename.empty())
+    {
+        filename = "benchmarkScene.rsd";
+        generateScene(filename, 5000);
+        generated = true;
+    }
+
+    try
+    {
+        if (section == "all" || section == "load")
+            benchmarkLoad(filename, iterations);
+        if (section == "all" || section == "stream")
+            benchmarkStream(filename, iterations);
+        if (section == "all" || section == "includes")
+            benchmarkIncludes(iterations);
+        if (section == "all" || section == "cache")
+            benchmarkCache(iterations);
+        if (section == "all" || section == "binary")
+            benchmarkBinary(filename, iterations);
+        if (section == "all" || section == "lazy")
+            benchmarkLazy(iterations);
+        if (section == "all" || section == "write")
+            benchmarkWrite(filename, iterations);
+        if (section == "all" || section == "reload")
+            benchmarkReload(iterations);
+        if (section == "all" || section == "async")
+            benchmarkAsync(filename, iterations);
+        if (section == "all" || section == "bundle")
+            benchmarkBundle(iterations);
+        if (section == "all" || section == "parse")
+            benchmarkParse(filename, iterations);
+        if (section == "all" || section == "numbers")
+            benchmarkNumbers(iterations);
+        if (section == "all" || section == "parallel")
+            benchmarkParallel(filename, iterations);
+        if (section == "all" || section == "events")
+            benchmarkEvents(filename, iterations);
+        if (section == "all" || section == "interpolate")
+            benchmarkInterpolate(iterations);
+        if (section == "all" || section == "references")
+            benchmarkReferences(iterations);
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << "ERROR: " << pe.source() << ':' << pe.line() << ":"
+                  << pe.pos() << ": " << pe.description() << std::endl;
+        return 2;
+    }
+    catch (Exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 2;
+    }
+
+    if (generated)
+    {
+        std::remove(filename.c_str());
+    }
+    return 0;
+}
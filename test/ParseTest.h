@@ -0,0 +1,120 @@
+////////////
+//
+//  File:      ParseTest.h
+//  Module:    RSD
+//  Author:    Michael Farnsworth
+//  Copyright: (C)2012 by Michael Farnsworth, All Rights Reserved
+//  Content:   Parsing the same inputs several ways and comparing the results
+//
+////////////
+
+#ifndef __RSD_ParseTest_h__
+#define __RSD_ParseTest_h__
+
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Rsd/Parser.h>
+
+
+namespace ParseTest
+{
+
+
+// One way of parsing an input, giving a description of what it parsed to
+struct Way
+{
+    std::string m_name;
+    std::function<std::string (const std::string&)> m_parse;
+};
+
+
+// What parsing the input this way gives, or the error with its line and position
+inline std::string parseOrError(const Way& way, const std::string& input)
+{
+    try
+    {
+        return way.m_parse(input);
+    }
+    catch (RenderSpud::Rsd::Parser::ParseException& pe)
+    {
+        std::ostringstream result;
+        result << "error " << pe.line() << ":" << pe.pos() << ": " << pe.description();
+        return result.str();
+    }
+    catch (RenderSpud::Rsd::Exception& e)
+    {
+        return std::string("error: ") + e.what();
+    }
+}
+
+
+inline bool isError(const std::string& result)
+{
+    return result.compare(0, 5, "error") == 0;
+}
+
+
+// Up to 200 characters of a result, starting a little before where it first
+// differs from the other one, so big inputs show where they went wrong
+inline std::string excerpt(const std::string& result, const std::string& other)
+{
+    size_t start = 0;
+    while (start < result.length() && start < other.length() && result[start] == other[start])
+    {
+        ++start;
+    }
+    start = start > 50 ? start - 50 : 0;
+    return (start > 0 ? "..." : "") + result.substr(start, 200);
+}
+
+
+// Parse every input every way, making sure each way gives the same as the
+// first (or, with anyErrorMatches, some error where the first gives one).
+// Reports every input that parsed differently, or that all of them parsed
+// the same, and gives the exit code for main.
+inline int compareParses(const std::vector<std::string>& inputs,
+                         const std::string& inputKind,
+                         const std::vector<Way>& ways,
+                         const std::string& sameHow,
+                         bool anyErrorMatches = false)
+{
+    size_t numFailed = 0;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::string expected = parseOrError(ways[0], inputs[i]);
+        for (size_t j = 1; j < ways.size(); ++j)
+        {
+            std::string result = parseOrError(ways[j], inputs[i]);
+            bool bothErrors = anyErrorMatches && isError(result) && isError(expected);
+            if (result != expected && !bothErrors)
+            {
+                std::cerr << "FAILED: " << inputKind << " " << i;
+                if (inputs[i].length() <= 40)
+                {
+                    std::cerr << " (" << inputs[i] << ")";
+                }
+                std::cerr << " parsed " << ways[j].m_name << " as:\n" << excerpt(result, expected)
+                          << "\nbut " << ways[0].m_name << " as:\n" << excerpt(expected, result) << std::endl;
+                ++numFailed;
+            }
+        }
+    }
+
+    if (numFailed > 0)
+    {
+        std::cerr << numFailed << " " << inputKind << " parses differed" << std::endl;
+        return 1;
+    }
+    std::cout << "// Parsed " << inputs.size() << " " << inputKind << "s the same " << sameHow << std::endl;
+    return 0;
+}
+
+
+} // namespace ParseTest
+
+
+#endif // __RSD_ParseTest_h__
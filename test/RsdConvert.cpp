@@ -0,0 +1,70 @@
+#include <iostream>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+bool hasExtension(const std::string& filename, const std::string& extension)
+{
+    return filename.length() > extension.length() &&
+           filename.compare(filename.length() - extension.length(),
+                            extension.length(),
+                            extension) == 0;
+}
+
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "ERROR: wrong number of commandline arguments." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <infile.rsd|.rsdb> <outfile.rsd|.rsdb|.rsda>" << std::endl;
+        std::cerr << "Converts between text and binary RSD; the output format is picked by" << std::endl;
+        std::cerr << "extension, the input format is detected.  Includes are not followed," << std::endl;
+        std::cerr << "except for .rsda, which bundles the input with all of its includes." << std::endl;
+        return 1;
+    }
+
+    std::string inFilename = argv[1];
+    std::string outFilename = argv[2];
+
+    try
+    {
+        if (hasExtension(outFilename, ".rsda"))
+        {
+            File::writeBundle(inFilename, outFilename);
+            return 0;
+        }
+
+        File::FilePtr pFile = new File(inFilename, LoadOptions(false));
+
+        if (hasExtension(outFilename, ".rsdb"))
+        {
+            pFile->writeBinary(outFilename);
+        }
+        else
+        {
+            pFile->write(outFilename);
+        }
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << "ERROR: " << pe.source() << ':' << pe.line() << ":"
+                  << pe.pos() << ": " << pe.description() << std::endl;
+        return 2;
+    }
+    catch (Exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Rsd/Parser.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+const char* const kScene =
+    "include \"lights.rsd\";\n"
+    "a = 1; \"b c\" = -2.5; d = true; e = \"x\\\"y\";\n"
+    "geo = @Geometry { file = \"/assets/tree.abc\"; xform = [1, 0, 0, [ ], { }]; };\n"
+    "inst = @Scene.Instance :geo { file = shot.root; n = { include \"inner.rsd\"; }; };\n"
+    "list = [ @Light { i = 2; }, :geo { }, f(x: 1), g.h[\"k\"][0], @T 3 ];\n"
+    "m = mk(x: :geo { y = @U [z(w: 1)]; }, v: [1, 2]);\n"
+    "r = a[m(q: { s = t[0]; })].b;\n"
+    "empty = { };\n";
+
+
+// Builds the values the events describe, the way the grammar would have
+class RebuildHandler : public Parser::ParseHandler
+{
+public:
+    RebuildHandler(Value& root) : m_stack(1, &root), m_names(), m_typeName() { }
+
+    virtual void name(const std::string& name) { m_names.push_back(name); }
+    virtual void typeName(const TypeName& typeName) { m_typeName = typeName; }
+
+    virtual void beginBlock(const Reference* pInheritFrom, size_t offset)
+    {
+        Value::Ptr pBlock(new Value(Value::kTypeBlock));
+        if (pInheritFrom)
+        {
+            pBlock->setInheritedBlock(Value::Ptr(new Value(pInheritFrom->clone())));
+        }
+        add(pBlock, offset);
+        m_stack.push_back(pBlock.get());
+    }
+    virtual void endBlock() { m_stack.pop_back(); }
+
+    virtual void beginArray(size_t offset)
+    {
+        Value::Ptr pArray(new Value(ValueArray()));
+        add(pArray, offset);
+        m_stack.push_back(pArray.get());
+    }
+    virtual void endArray() { m_stack.pop_back(); }
+
+    virtual void booleanValue(bool value, size_t offset)               { add(Value::Ptr(new Value(value)), offset); }
+    virtual void integerValue(long value, size_t offset)               { add(Value::Ptr(new Value(value)), offset); }
+    virtual void floatValue(double value, size_t offset)               { add(Value::Ptr(new Value(value)), offset); }
+    virtual void stringValue(const std::string& value, size_t offset)  { add(Value::Ptr(new Value(value)), offset); }
+    virtual void reference(const Reference& ref, size_t offset)        { add(Value::Ptr(new Value(ref.clone())), offset); }
+    virtual void macro(const MacroInvocation& macro, size_t offset)    { add(Value::Ptr(new Value(macro.clone())), offset); }
+
+    virtual void include(const std::string& filename, size_t offset)
+    {
+        Value::Ptr pInclude(new Value());
+        pInclude->typeName().push_back("include");
+        m_stack.back()->appendValue(filename, pInclude);
+    }
+
+private:
+    void add(Value::Ptr pValue, size_t offset)
+    {
+        pValue->setOffset(offset);
+        pValue->setTypeName(m_typeName);
+        m_typeName = TypeName();
+        Value* pParent = m_stack.back();
+        if (pParent->type() == Value::kTypeBlock)
+        {
+            pParent->appendValue(m_names.back(), pValue);
+            m_names.pop_back();
+        }
+        else
+        {
+            pParent->appendValue(pValue);
+        }
+    }
+
+    std::vector<Value*> m_stack;
+    std::vector<std::string> m_names;
+    TypeName m_typeName;
+};
+
+
+// Writes down each event, one per line
+class TranscriptHandler : public Parser::ParseHandler
+{
+public:
+    std::ostringstream m_text;
+
+    virtual void name(const std::string& name)                        { m_text << "name " << name << "\n"; }
+    virtual void typeName(const TypeName& typeName)                   { m_text << "type " << typeName.size() << "\n"; }
+    virtual void beginBlock(const Reference* pInheritFrom, size_t offset)
+    {
+        m_text << "{ @" << offset << (pInheritFrom ? " : " + pInheritFrom->str() : std::string()) << "\n";
+    }
+    virtual void endBlock()                                           { m_text << "}\n"; }
+    virtual void beginArray(size_t offset)                            { m_text << "[ @" << offset << "\n"; }
+    virtual void endArray()                                           { m_text << "]\n"; }
+    virtual void integerValue(long value, size_t offset)              { m_text << value << "\n"; }
+    virtual void reference(const Reference& ref, size_t offset)       { m_text << "ref " << ref.str() << "\n"; }
+    virtual void include(const std::string& filename, size_t offset)  { m_text << "include " << filename << "\n"; }
+};
+
+
+// The serialized tree, and where each value in it came from
+void describe(const Value& value, std::ostream& result)
+{
+    result << value.offset() << " ";
+    for (size_t i = 0; i < value.values().size(); ++i)
+    {
+        describe(*value.values()[i], result);
+    }
+}
+
+std::string describe(const Value& root)
+{
+    std::ostringstream result;
+    result << root.str(true);
+    describe(root, result);
+    return result.str();
+}
+
+
+std::string parseError(const std::string& text, bool events)
+{
+    try
+    {
+        Parser::Parser parser;
+        Value::Ptr pRoot(new Value(Value::kTypeBlock));
+        Parser::ParseHandler handler;
+        if (events)
+        {
+            parser.parse(text, handler);
+        }
+        else
+        {
+            parser.parse(text, *pRoot);
+        }
+        return "no error";
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::ostringstream result;
+        result << pe.line() << ":" << pe.pos() << ": " << pe.description();
+        return result.str();
+    }
+}
+
+}
+
+
+// Parse with a handler rather than into values: the events rebuild the same
+// tree (offsets and all), come in the order the input has them, and errors
+// are the same either way
+int main(int argc, char **argv)
+{
+    size_t numFailed = 0;
+
+    Parser::Parser parser;
+    Value::Ptr pParsed(new Value(Value::kTypeBlock));
+    parser.parse(kScene, *pParsed);
+    std::string expected = describe(*pParsed);
+
+    Value::Ptr pRebuilt(new Value(Value::kTypeBlock));
+    RebuildHandler rebuildHandler(*pRebuilt);
+    parser.parse(kScene, rebuildHandler);
+    if (describe(*pRebuilt) != expected)
+    {
+        std::cerr << "FAILED: events rebuilt\n" << describe(*pRebuilt) << "\nrather than\n" << expected << std::endl;
+        ++numFailed;
+    }
+
+    Value::Ptr pStreamed(new Value(Value::kTypeBlock));
+    RebuildHandler streamHandler(*pStreamed);
+    std::istringstream stream(kScene);
+    parser.parse(stream, 16, streamHandler);
+    if (describe(*pStreamed) != expected)
+    {
+        std::cerr << "FAILED: streamed events rebuilt\n" << describe(*pStreamed) << std::endl;
+        ++numFailed;
+    }
+
+    TranscriptHandler transcript;
+    parser.parse("include \"x.rsd\"; a = @T.U :b.c { d = [1, { }]; e = f[2]; };", transcript);
+    std::string expectedTranscript =
+        "include x.rsd\n"
+        "name a\n"
+        "type 2\n"
+        "{ @31 : b.c\n"
+        "name d\n"
+        "[ @37\n"
+        "1\n"
+        "{ @41\n"
+        "}\n"
+        "]\n"
+        "name e\n"
+        "ref f[2]\n"
+        "}\n";
+    if (transcript.m_text.str() != expectedTranscript)
+    {
+        std::cerr << "FAILED: events came as\n" << transcript.m_text.str() << "rather than\n" << expectedTranscript;
+        ++numFailed;
+    }
+
+    const char* const badScenes[] = { "a = [1, 2;", "a = { b = 1; ", "a = m(x: 1;", "a = #;", "a = \"x" };
+    for (size_t i = 0; i < sizeof(badScenes) / sizeof(badScenes[0]); ++i)
+    {
+        std::string withValues = parseError(badScenes[i], false);
+        std::string withEvents = parseError(badScenes[i], true);
+        if (withEvents != withValues || withEvents == "no error")
+        {
+            std::cerr << "FAILED: " << badScenes[i] << " gave " << withEvents
+                      << " with events, and " << withValues << " with values" << std::endl;
+            ++numFailed;
+        }
+    }
+
+    if (numFailed > 0)
+    {
+        std::cerr << numFailed << " event parses failed" << std::endl;
+        return 1;
+    }
+    std::cout << "// Events matched the values parsed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <Rsd/Parser.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+// Heap allocations not yet freed, across the whole program
+std::atomic<long> g_numLiveAllocations(0);
+
+}
+
+
+void* operator new(size_t size)
+{
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    ++g_numLiveAllocations;
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p)
+    {
+        --g_numLiveAllocations;
+        std::free(p);
+    }
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+
+namespace
+{
+
+const char* const kBadScenes[] =
+{
+    // Open blocks and arrays full of values, with the error deep inside
+    "a = @T { b = [1, 2.5, \"three\", { c = [x.y[0], m(k: { d = 4; })]; }]; e = { f = 1; g = [[[1, 2",
+    "a = :b.c[\"d\"] { e = @U.V [1, 2, { f = \"g\"; }]; h = 5 6; };",
+    "a = m(x: [1, 2], y: { z = :q { r = 1; }; }, w: ",
+    "a = { b = 1; c = ; };",
+    "a = [1, 2, #];"
+};
+const size_t kNumBadScenes = sizeof(kBadScenes) / sizeof(kBadScenes[0]);
+
+const char* const kBadReferences[] = { "a[m(x: { b = [1, 2]; })].", "a[b[c[d[" };
+const size_t kNumBadReferences = sizeof(kBadReferences) / sizeof(kBadReferences[0]);
+
+
+// Parse every bad scene into values, with a handler, and as a stream, and
+// every bad reference; gives the number that did not fail
+size_t parseBadInput()
+{
+    size_t numParsed = 0;
+    Parser::Parser parser;
+    for (size_t i = 0; i < kNumBadScenes; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            try
+            {
+                Value::Ptr pRoot(new Value(Value::kTypeBlock));
+                Parser::ParseHandler handler;
+                std::istringstream stream(kBadScenes[i]);
+                if (j == 0)
+                {
+                    parser.parse(kBadScenes[i], *pRoot);
+                }
+                else if (j == 1)
+                {
+                    parser.parse(kBadScenes[i], handler);
+                }
+                else
+                {
+                    parser.parse(stream, 7, *pRoot);
+                }
+                ++numParsed;
+            }
+            catch (Parser::ParseException&)
+            {
+            }
+        }
+    }
+    for (size_t i = 0; i < kNumBadReferences; ++i)
+    {
+        try
+        {
+            Reference::Ptr pRef(new Reference());
+            parser.parseReference(kBadReferences[i], *pRef);
+            ++numParsed;
+        }
+        catch (Parser::ParseException&)
+        {
+        }
+    }
+    return numParsed;
+}
+
+}
+
+
+// Parse bad input over and over, making sure that whatever the grammar had
+// built before the error is freed every time
+int main(int argc, char **argv)
+{
+    const size_t kNumRepeats = 1000;
+
+    // The first parses set up the thread's context, which is kept
+    size_t numParsed = parseBadInput();
+    long numAllocationsBefore = g_numLiveAllocations;
+    for (size_t i = 0; i < kNumRepeats; ++i)
+    {
+        numParsed += parseBadInput();
+    }
+    long numLeaked = g_numLiveAllocations - numAllocationsBefore;
+
+    if (numParsed > 0)
+    {
+        std::cerr << "FAILED: " << numParsed << " bad parses did not throw" << std::endl;
+        return 1;
+    }
+    if (numLeaked != 0)
+    {
+        std::cerr << "FAILED: " << numLeaked << " allocations left over after "
+                  << kNumRepeats << " rounds of failed parses" << std::endl;
+        return 1;
+    }
+    std::cout << "// Nothing left over after " << kNumRepeats << " rounds of failed parses" << std::endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+void writeFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream stream(filename.c_str());
+    stream << contents;
+}
+
+
+bool check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << description << std::endl;
+    }
+    return condition;
+}
+
+
+// Reads the file-index map every File keeps, which is otherwise only for
+// File itself to use
+struct FileIndexMapAccess : public File
+{
+    static const FileIndexMap& of(const File& file)
+    {
+        FileIndexMap File::* pMap = &FileIndexMapAccess::m_fileIndexMap;
+        return file.*pMap;
+    }
+};
+
+
+// The file every value came from and the file-index map of every File (once
+// it is loaded), in tree order
+void describeFiles(const Value& v, std::ostream& stream)
+{
+    stream << v.file() << ' ';
+    size_t size = v.size();
+    const File* pFile = dynamic_cast<const File*>(&v);
+    if (pFile)
+    {
+        const std::vector<std::string>& fileIndexMap = FileIndexMapAccess::of(*pFile);
+        stream << "[ ";
+        for (size_t i = 0; i < fileIndexMap.size(); ++i)
+        {
+            stream << fileIndexMap[i] << ' ';
+        }
+        stream << "] ";
+    }
+    for (size_t i = 0; i < size; ++i)
+    {
+        describeFiles(*v.value(i), stream);
+    }
+}
+
+std::string describeFiles(const Value& v)
+{
+    std::ostringstream result;
+    describeFiles(v, result);
+    return result.str();
+}
+
+}
+
+
+// Load nested includes lazily, and make sure indexing into an include loads
+// it just as a lookup by name does, giving the same tree as an eager load
+int main(int argc, char **argv)
+{
+    const std::string rootFilename = "./lazyTest.rsd";
+    const std::string aFilename = "./lazyTest.a.rsd";
+    const std::string a1Filename = "./lazyTest.a1.rsd";
+    const std::string bFilename = "./lazyTest.b.rsd";
+
+    bool passed = true;
+    try
+    {
+        writeFile(a1Filename, "deep = { x = 1; };\n");
+        writeFile(aFilename,
+                  "include \"lazyTest.a1.rsd\";\n"
+                  "a = [1, 2, 3];\n");
+        writeFile(bFilename, "b = { y = \"two\"; };\n");
+        writeFile(rootFilename,
+                  "include \"lazyTest.a.rsd\";\n"
+                  "include \"lazyTest.b.rsd\";\n"
+                  "root = 0;\n");
+
+        File::FilePtr pEager = new File(rootFilename);
+        LoadOptions lazyOptions;
+        lazyOptions.m_lazyIncludes = true;
+
+        // Indexing and listing load the include without a lookup by name
+        File::FilePtr pLazy = new File(rootFilename, lazyOptions);
+        passed &= check(pLazy->sourceFiles().size() == 1, "no includes loaded up front");
+        passed &= check(pLazy->value(0)->size() == 2, "size() of a lazy include");
+        passed &= check(pLazy->sourceFiles().size() == 2, "size() loaded just that include");
+
+        pLazy = new File(rootFilename, lazyOptions);
+        passed &= check((*pLazy)[1].values().size() == 1, "values() of a lazy include");
+        pLazy = new File(rootFilename, lazyOptions);
+        passed &= check((*pLazy)[1][0]["y"].asString() == "two", "operator[](size_t) on a lazy include");
+        pLazy = new File(rootFilename, lazyOptions);
+        Value::Ptr pDeep = pLazy->value(0)->value(0)->value(0);
+        passed &= check(pDeep && pDeep->value(0)->asInteger() == 1, "value(size_t) on nested lazy includes");
+
+        // Walking by index alone reaches every value an eager load has, each
+        // from the same file and numbered the same, whatever order the
+        // includes load in
+        pLazy = new File(rootFilename, lazyOptions);
+        passed &= check(pLazy->value(0)->file() == aFilename, "file of an include not loaded yet");
+        passed &= check(pLazy->value(1)->size() == 1, "loading the second include first");
+        std::string eagerFiles = describeFiles(*pEager);
+        std::string lazyFiles = describeFiles(*pLazy);
+        passed &= check(lazyFiles == eagerFiles, "lazy values came from " + lazyFiles + "rather than " + eagerFiles);
+        passed &= check(pLazy->str(true) == pEager->str(true), "lazy tree matches the eager one");
+        passed &= check(pLazy->sourceFiles().size() == pEager->sourceFiles().size(),
+                        "every lazy include loaded");
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+        passed = false;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "FAILED: " << e.what() << std::endl;
+        passed = false;
+    }
+
+    std::remove(rootFilename.c_str());
+    std::remove(aFilename.c_str());
+    std::remove(a1Filename.c_str());
+    std::remove(bFilename.c_str());
+
+    if (!passed)
+    {
+        return 1;
+    }
+    std::cout << "// Lazy includes loaded on indexing, matching an eager load" << std::endl;
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+void writeFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream stream(filename.c_str());
+    stream << contents;
+}
+
+
+// Reads the file-index map every File keeps, which is otherwise only for
+// File itself to use
+struct FileIndexMapAccess : public File
+{
+    static const FileIndexMap& of(const File& file)
+    {
+        FileIndexMap File::* pMap = &FileIndexMapAccess::m_fileIndexMap;
+        return file.*pMap;
+    }
+};
+
+
+// The file-index map of every File in the tree, and the file each value came
+// from, in tree order
+void describe(const Value& v, std::ostream& stream)
+{
+    const File* pFile = dynamic_cast<const File*>(&v);
+    if (pFile)
+    {
+        const std::vector<std::string>& fileIndexMap = FileIndexMapAccess::of(*pFile);
+        stream << "\n[";
+        for (size_t i = 0; i < fileIndexMap.size(); ++i)
+        {
+            stream << ' ' << fileIndexMap[i];
+        }
+        stream << " ]\n";
+    }
+    stream << v.file() << ' ';
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        describe(*v.values()[i], stream);
+    }
+}
+
+std::string describe(const File& file)
+{
+    std::ostringstream result;
+    std::vector<std::string> sourceFiles = file.sourceFiles();
+    for (size_t i = 0; i < sourceFiles.size(); ++i)
+    {
+        result << sourceFiles[i] << ' ';
+    }
+    describe(file, result);
+    return result.str();
+}
+
+}
+
+
+// Load nested includes on include threads, and make sure the files are
+// numbered and attributed exactly as when they are loaded one by one
+int main(int argc, char **argv)
+{
+    const std::string rootFilename = "./threadedTest.rsd";
+    const std::string aFilename = "./threadedTest.a.rsd";
+    const std::string a1Filename = "./threadedTest.a1.rsd";
+    const std::string bFilename = "./threadedTest.b.rsd";
+
+    bool passed = true;
+    try
+    {
+        writeFile(a1Filename, "deep = { x = [1, 2]; };\n");
+        writeFile(aFilename,
+                  "before = 1;\n"
+                  "include \"threadedTest.a1.rsd\";\n"
+                  "a = { nested = { include \"threadedTest.b.rsd\"; }; };\n");
+        writeFile(bFilename, "b = { y = \"two\"; };\n");
+        writeFile(rootFilename,
+                  "include \"threadedTest.a.rsd\";\n"
+                  "middle = [ { z = 3; } ];\n"
+                  "include \"threadedTest.b.rsd\";\n"
+                  "root = 0;\n");
+
+        LoadOptions serialOptions;
+        serialOptions.m_includeThreads = 0;
+        File::FilePtr pSerial = new File(rootFilename, serialOptions);
+        std::string expected = describe(*pSerial);
+
+        LoadOptions threadedOptions;
+        threadedOptions.m_includeThreads = 4;
+        for (size_t i = 0; i < 20; ++i)
+        {
+            File::FilePtr pThreaded = new File(rootFilename, threadedOptions);
+            std::string threaded = describe(*pThreaded);
+            if (threaded != expected)
+            {
+                std::cerr << "FAILED: loading on include threads gave\n" << threaded
+                          << "\nrather than\n" << expected << std::endl;
+                passed = false;
+                break;
+            }
+        }
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+        passed = false;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "FAILED: " << e.what() << std::endl;
+        passed = false;
+    }
+
+    std::remove(rootFilename.c_str());
+    std::remove(aFilename.c_str());
+    std::remove(a1Filename.c_str());
+    std::remove(bFilename.c_str());
+
+    if (!passed)
+    {
+        return 1;
+    }
+    std::cout << "// Include threads numbered the files the same as a serial load" << std::endl;
+    return 0;
+}
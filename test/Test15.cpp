@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+void writeFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream stream(filename.c_str());
+    stream << contents;
+}
+
+
+bool check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << description << std::endl;
+    }
+    return condition;
+}
+
+
+// Where and why a load failed, or "no error"
+std::string describeError(const std::function<void ()>& load)
+{
+    try
+    {
+        load();
+        return "no error";
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::ostringstream result;
+        result << pe.line() << ":" << pe.pos() << ": " << pe.description();
+        return result.str();
+    }
+}
+
+
+// Holds onLoaded callbacks until released, so loads can be kept from
+// starting by filling the pool with callbacks that have not returned
+class Gate
+{
+public:
+    Gate() : m_mutex(), m_changed(), m_numWaiting(0), m_open(false) { }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_numWaiting;
+        m_changed.notify_all();
+        while (!m_open)
+        {
+            m_changed.wait(lock);
+        }
+        --m_numWaiting;
+        m_changed.notify_all();
+    }
+
+    // Wait until exactly this many callbacks are held at the gate
+    void waitForWaiting(size_t numWaiting)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_numWaiting != numWaiting)
+        {
+            m_changed.wait(lock);
+        }
+    }
+
+    void open()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_open = true;
+        m_changed.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    size_t m_numWaiting;
+    bool m_open;
+};
+
+}
+
+
+// Load files in the background: several at once give the same files as
+// loading in the foreground, errors come back out of get(), onLoaded sees
+// each finished load, and a cancelled load throws LoadCancelledException
+int main(int argc, char **argv)
+{
+    const std::string goodFilename = "./asyncTest.rsd";
+    const std::string includeFilename = "./asyncTest.include.rsd";
+    const std::string badFilename = "./asyncTest.bad.rsd";
+
+    bool passed = true;
+    try
+    {
+        writeFile(includeFilename, "light = { intensity = 2.5; };\n");
+        writeFile(goodFilename,
+                  "include \"asyncTest.include.rsd\";\n"
+                  "frame = 101;\n"
+                  "geo = @Mesh { points = [1, 2, 3]; };\n");
+        writeFile(badFilename, "a = 1;\nb = [1, 2;\n");
+
+        std::string expected = File::FilePtr(new File(goodFilename))->str(true);
+
+        // Several loads at once, each calling back when done
+        const size_t kNumLoads = 8;
+        std::atomic<size_t> numCalledBack(0);
+        std::atomic<size_t> numCalledBackReady(0);
+        std::vector<FileLoad> loads;
+        for (size_t i = 0; i < kNumLoads; ++i)
+        {
+            loads.push_back(File::loadAsync(goodFilename, LoadOptions(),
+                                            [&](const FileLoad& load)
+                                            {
+                                                if (load.isReady() && load.get()->str(true) == expected)
+                                                {
+                                                    ++numCalledBackReady;
+                                                }
+                                                ++numCalledBack;
+                                            }));
+        }
+        for (size_t i = 0; i < loads.size(); ++i)
+        {
+            passed &= check(loads[i].valid(), "background load is valid");
+            passed &= check(loads[i].get()->str(true) == expected, "background load matches a foreground one");
+        }
+        for (size_t i = 0; i < 1000 && numCalledBack < kNumLoads; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        passed &= check(numCalledBack == kNumLoads, "onLoaded called once per load");
+        passed &= check(numCalledBackReady == kNumLoads, "onLoaded saw each load finished");
+
+        // A parse error comes back out of get(), the same as in the foreground
+        std::string expectedError = describeError([&]() { File::FilePtr pFile = new File(badFilename); });
+        FileLoad badLoad = File::loadAsync(badFilename);
+        std::string error = describeError([&]() { badLoad.get(); });
+        passed &= check(expectedError != "no error" && error == expectedError,
+                        "background parse error was " + error + " rather than " + expectedError);
+        error = describeError([&]() { badLoad.get(); });
+        passed &= check(error == expectedError, "parse error rethrown on every get()");
+
+        // Keep every loading thread busy in a callback, so the load is
+        // cancelled before it can start
+        const size_t kNumPoolThreads = std::max<unsigned int>(std::thread::hardware_concurrency(), 2);
+        Gate gate;
+        std::vector<FileLoad> blockers;
+        for (size_t i = 0; i < kNumPoolThreads; ++i)
+        {
+            blockers.push_back(File::loadAsync(includeFilename, LoadOptions(),
+                                               [&](const FileLoad&) { gate.wait(); }));
+        }
+        gate.waitForWaiting(kNumPoolThreads);
+        std::atomic<size_t> numCancelledCalledBack(0);
+        FileLoad cancelledLoad = File::loadAsync(goodFilename, LoadOptions(),
+                                                 [&](const FileLoad&) { ++numCancelledCalledBack; });
+        passed &= check(!cancelledLoad.isReady(), "load waits for a free thread");
+        cancelledLoad.cancel();
+        gate.open();
+        gate.waitForWaiting(0);
+        bool threwCancelled = false;
+        try
+        {
+            cancelledLoad.get();
+        }
+        catch (LoadCancelledException&)
+        {
+            threwCancelled = true;
+        }
+        passed &= check(threwCancelled, "cancelled load throws LoadCancelledException");
+        for (size_t i = 0; i < blockers.size(); ++i)
+        {
+            passed &= check(blockers[i].get()->value("light") != NULL, "loads before the cancelled one kept their result");
+        }
+        for (size_t i = 0; i < 1000 && numCancelledCalledBack == 0; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        passed &= check(numCancelledCalledBack == 1, "onLoaded called for a cancelled load");
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+        passed = false;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "FAILED: " << e.what() << std::endl;
+        passed = false;
+    }
+
+    std::remove(goodFilename.c_str());
+    std::remove(includeFilename.c_str());
+    std::remove(badFilename.c_str());
+
+    if (!passed)
+    {
+        return 1;
+    }
+    std::cout << "// Background loads matched foreground ones, errors and cancelling included" << std::endl;
+    return 0;
+}
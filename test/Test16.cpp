@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+void writeFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream stream(filename.c_str());
+    stream << contents;
+}
+
+
+bool check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << description << std::endl;
+    }
+    return condition;
+}
+
+}
+
+
+// Pack a scene into a bundle and load it back: the tree is the same as from
+// the loose files, even with the files gone, and includes that reach the
+// same file through differently spelled paths all find it in the bundle
+int main(int argc, char **argv)
+{
+    const std::string directories[] = { "bundleTest", "bundleTest/scene", "bundleTest/scene/sub",
+                                        "bundleTest/shared" };
+    const size_t numDirectories = sizeof(directories) / sizeof(directories[0]);
+    const std::string rootFilename = "bundleTest/scene/root.rsd";
+    const std::string bundleFilename = "bundleTest/scene.rsda";
+    std::vector<std::string> files;
+    files.push_back(rootFilename);
+    files.push_back("bundleTest/scene/sub/a.rsd");
+    files.push_back("bundleTest/scene/sub/c.rsd");
+    files.push_back("bundleTest/scene/b.rsd");
+    files.push_back("bundleTest/shared/s.rsd");
+
+    bool passed = true;
+    try
+    {
+        for (size_t i = 0; i < numDirectories; ++i)
+        {
+            mkdir(directories[i].c_str(), 0755);
+        }
+        writeFile(files[0],
+                  "include \"sub/a.rsd\";\n"
+                  "include \"./sub/../b.rsd\";\n"
+                  "root = { frame = 101; };\n");
+        writeFile(files[1],
+                  "include \"../b.rsd\";\n"
+                  "include \"c.rsd\";\n"
+                  "a = { c = { include \".//c.rsd\"; }; };\n");
+        writeFile(files[2],
+                  "include \"../../shared/s.rsd\";\n"
+                  "c = [1, 2.5, \"three\"];\n");
+        writeFile(files[3], "b = @Light { intensity = 2; };\n");
+        writeFile(files[4], "s = \"shared\";\n");
+
+        File::FilePtr pLoose = new File(rootFilename);
+        std::string expected = pLoose->str(true);
+        File::writeBundle(rootFilename, bundleFilename);
+
+        // Each file is stored once, however many ways it was included
+        std::ifstream bundleStream(bundleFilename.c_str(), std::ios::binary);
+        std::string bundle((std::istreambuf_iterator<char>(bundleStream)), std::istreambuf_iterator<char>());
+        const char* const uniqueContents[] = { "b = @Light", "c = [1", "s = \"shared\"" };
+        for (size_t i = 0; i < sizeof(uniqueContents) / sizeof(uniqueContents[0]); ++i)
+        {
+            size_t first = bundle.find(uniqueContents[i]);
+            passed &= check(first != std::string::npos &&
+                            bundle.find(uniqueContents[i], first + 1) == std::string::npos,
+                            std::string("bundle holds ") + uniqueContents[i] + " once");
+        }
+
+        // Everything must come from the bundle now
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            std::remove(files[i].c_str());
+        }
+        File::FilePtr pBundled = new File(bundleFilename);
+        passed &= check(pBundled->str(true) == expected,
+                        "bundle loaded as\n" + pBundled->str(true) + "\nrather than\n" + expected);
+        passed &= check(pBundled->sourceFiles().empty(), "bundled files are not reloaded from disk");
+
+        Value::Ptr pShared = pBundled->Value::find(std::string("s"));
+        passed &= check(pShared && pShared->asString() == "shared", "include from outside the root's directory");
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+        passed = false;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "FAILED: " << e.what() << std::endl;
+        passed = false;
+    }
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        std::remove(files[i].c_str());
+    }
+    std::remove(bundleFilename.c_str());
+    for (size_t i = numDirectories; i > 0; --i)
+    {
+        rmdir(directories[i - 1].c_str());
+    }
+
+    if (!passed)
+    {
+        return 1;
+    }
+    std::cout << "// Bundled scene loaded the same as the loose files" << std::endl;
+    return 0;
+}
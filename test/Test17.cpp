@@ -0,0 +1,190 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Tokenizer.h"
+
+
+using namespace RenderSpud::Rsd::Parser;
+
+
+namespace
+{
+
+// Every token in the text, as "offset:type value", or where and why
+// tokenizing stopped.  The text is copied into a buffer of exactly its
+// length, so nothing past the end can be read without being noticed.
+std::string tokenize(const std::string& text)
+{
+    std::vector<char> buffer(text.begin(), text.end());
+    const char* input = buffer.empty() ? NULL : &buffer[0];
+
+    std::ostringstream result;
+    size_t index = 0;
+    try
+    {
+        while (index < buffer.size())
+        {
+            Token token;
+            index = Token::parseToken(index, input, buffer.size(), token);
+            if (token.isWhitespace())
+            {
+                continue;
+            }
+            result << token.offset() << ':' << token.description();
+            if (token.isInteger())
+            {
+                result << ' ' << token.integerValue();
+            }
+            else if (token.isFloat())
+            {
+                result << ' ' << token.floatValue();
+            }
+            else if (token.isIdentifier() || token.isString())
+            {
+                result << ' ' << token.textValue();
+            }
+            result << ' ';
+        }
+    }
+    catch (TokenException& te)
+    {
+        result << "error " << te.offset() << ": " << (te.what() ? te.what() : "");
+    }
+    return result.str();
+}
+
+
+struct TokenCase
+{
+    const char* m_pText;
+    const char* m_pTokens;
+};
+
+// Malformed and borderline number literals, with the tokens (or error) they
+// give now, which is how the tokenizer has always treated them
+const TokenCase kCases[] =
+{
+    { "1e",     "0:float 1 " },
+    { "1e-",    "0:float 1 " },
+    { "0x",     "0:integer 0 " },
+    { "0b",     "0:integer 0 " },
+    { "08",     "0:integer 8 " },
+    { "07-",    "0:integer 7 error 2: invalid number literal" },
+    { "1.2.3",  "error 3: invalid number literal" },
+    { "1e5e5",  "error 3: invalid number literal" },
+    { "-abc",   "0:integer 0 1:identifier abc " },
+    { "- 5",    "0:integer 0 2:integer 5 " },
+    { ".5",     "0:float 0.5 " },
+    { "5.",     "0:float 5 " },
+    { "0xg",    "0:integer 0 2:identifier g " }
+};
+const size_t kNumCases = sizeof(kCases) / sizeof(kCases[0]);
+
+
+// Run lengths around the 16 bytes the tokenizer scans at a time
+const size_t kRunLengths[] = { 15, 16, 17, 31, 32, 33 };
+const size_t kNumRunLengths = sizeof(kRunLengths) / sizeof(kRunLengths[0]);
+
+
+// length characters cycling through the given ones
+std::string run(const std::string& characters, size_t length)
+{
+    std::string result;
+    for (size_t i = 0; i < length; ++i)
+    {
+        result += characters[i % characters.length()];
+    }
+    return result;
+}
+
+
+std::string expectToken(size_t offset, const std::string& token)
+{
+    std::ostringstream result;
+    result << offset << ':' << token << ' ';
+    return result.str();
+}
+
+
+// Whitespace, identifier, digit, string and comment runs of each length,
+// both followed by another token and running right up to the end of the
+// input, with the tokens they must give
+void makeRunCases(std::vector<std::string>& outTexts, std::vector<std::string>& outTokens)
+{
+    for (size_t i = 0; i < kNumRunLengths; ++i)
+    {
+        size_t length = kRunLengths[i];
+
+        std::string whitespace = run(" \t\r\n", length);
+        outTexts.push_back("a" + whitespace + "b");
+        outTokens.push_back(expectToken(0, "identifier a") + expectToken(length + 1, "identifier b"));
+        outTexts.push_back("a" + whitespace);
+        outTokens.push_back(expectToken(0, "identifier a"));
+
+        std::string identifier = "x" + run("aZ_9", length - 1);
+        outTexts.push_back(identifier + ";");
+        outTokens.push_back(expectToken(0, "identifier " + identifier) + expectToken(length, ";"));
+        outTexts.push_back(identifier);
+        outTokens.push_back(expectToken(0, "identifier " + identifier));
+
+        std::string digits = run("0", length - 1) + "7";
+        outTexts.push_back(digits + ",");
+        outTokens.push_back(expectToken(0, "integer 7") + expectToken(length, ","));
+        outTexts.push_back(digits);
+        outTokens.push_back(expectToken(0, "integer 7"));
+        outTexts.push_back("2." + run("0", length));
+        outTokens.push_back(expectToken(0, "float 2"));
+
+        std::string text = run("abc ", length);
+        outTexts.push_back("\"" + text + "\"");
+        outTokens.push_back(expectToken(0, "string " + text));
+        outTexts.push_back("\"" + text + "\\\"\"");
+        outTokens.push_back(expectToken(0, "string " + text + "\""));
+        outTexts.push_back("\"" + text);
+        outTokens.push_back("error 0: unterminated string literal");
+
+        outTexts.push_back("a //" + text + "\nb");
+        outTokens.push_back(expectToken(0, "identifier a") + expectToken(length + 5, "identifier b"));
+        outTexts.push_back("a //" + text);
+        outTokens.push_back(expectToken(0, "identifier a"));
+    }
+}
+
+}
+
+
+// Tokenize number-like text, and runs of each kind across 16-byte
+// boundaries, and make sure each gives exactly the tokens or error it
+// always has
+int main(int argc, char **argv)
+{
+    std::vector<std::string> texts, expectedTokens;
+    for (size_t i = 0; i < kNumCases; ++i)
+    {
+        texts.push_back(kCases[i].m_pText);
+        expectedTokens.push_back(kCases[i].m_pTokens);
+    }
+    makeRunCases(texts, expectedTokens);
+
+    size_t numFailed = 0;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        std::string tokens = tokenize(texts[i]);
+        if (tokens != expectedTokens[i])
+        {
+            std::cerr << "FAILED: \"" << texts[i] << "\" gave \"" << tokens
+                      << "\" rather than \"" << expectedTokens[i] << "\"" << std::endl;
+            ++numFailed;
+        }
+    }
+
+    if (numFailed > 0)
+    {
+        std::cerr << numFailed << " of " << texts.size() << " texts tokenized differently" << std::endl;
+        return 1;
+    }
+    std::cout << "// Tokenized " << texts.size() << " texts as expected" << std::endl;
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+// Long tokens of every kind, a comment and CRLF line endings, so that at
+// some chunk size every token and every "\r\n" pair is split between chunks
+const char* const kScene =
+    "include \"streamChunks.rsd\";\r\n"
+    "// a comment that runs across a few chunks\r\n"
+    "longIdentifierName_123 = 1234567890123;\r\n"
+    "\"quoted name\" = -3.14159265358979e-10;\r\n"
+    "text = \"with \\\"escapes\\\" and \\\\ and ${some.reference}\";\r\n"
+    "\r\n"
+    "\r\n"
+    "block = @Type.Name :inherited.from[\"key\"][12] {\r\n"
+    "    ref = a.b.c[0];  flag = true;\r\n"
+    "    call = makeThing(first: [1, 2.5, \"three\"], second: { x = -7; });\r\n"
+    "};\r\n";
+
+// Bad input, with the error a few lines in
+const char* const kBadScene =
+    "a = 1;\r\n"
+    "b = [1, 2,\r\n"
+    "     3;\r\n";
+
+
+// The serialized tree, and the line and position of every value
+void describe(const Value& v, std::ostream& stream)
+{
+    stream << v.line() << ':' << v.pos() << ' ';
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        describe(*v.values()[i], stream);
+    }
+}
+
+std::string describe(const std::string& text, size_t chunkSize)
+{
+    std::ostringstream result;
+    try
+    {
+        LoadOptions options(false);
+        options.m_streamChunkSize = chunkSize;
+        std::istringstream stream(text);
+        File::FilePtr pFile = new File(stream, std::string("streamChunks"), ".", options);
+        result << pFile->str(true);
+        describe(*pFile, result);
+    }
+    catch (Parser::ParseException& pe)
+    {
+        result << "error " << pe.line() << ":" << pe.pos() << ": " << pe.description();
+    }
+    return result.str();
+}
+
+}
+
+
+// Parse streams in chunks of every size from one byte up to the whole
+// input, and make sure each gives the same tree, locations and errors as
+// reading the stream whole
+int main(int argc, char **argv)
+{
+    const char* const scenes[] = { kScene, kBadScene };
+    size_t numFailed = 0;
+    for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); ++i)
+    {
+        std::string text = scenes[i];
+        std::string expected = describe(text, 0);
+        for (size_t chunkSize = 1; chunkSize <= text.length() + 1; ++chunkSize)
+        {
+            std::string chunked = describe(text, chunkSize);
+            if (chunked != expected)
+            {
+                std::cerr << "FAILED: chunk size " << chunkSize << " gave\n" << chunked
+                          << "\nrather than\n" << expected << std::endl;
+                ++numFailed;
+            }
+        }
+    }
+
+    if (numFailed > 0)
+    {
+        std::cerr << numFailed << " chunked parses differed" << std::endl;
+        return 1;
+    }
+    std::cout << "// Parsed streams the same at every chunk size" << std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+// Line/position of every value, in tree order
+void describeLocations(const Value& v, std::ostream& stream)
+{
+    stream << v.line() << ':' << v.pos() << ' ';
+    for (size_t i = 0; i < v.values().size(); ++i)
+    {
+        describeLocations(*v.values()[i], stream);
+    }
+}
+
+}
+
+
+// Round-trip text through the binary format and make sure nothing changes
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::string testInput =
+            "include \"whatever.rsd\";\n"
+            "myValue = @\"Some\".Type\n"
+            "{\n"
+            "    someInt = -12345678901;\n"
+            "    someFloat = 3.14159265358979;\n"
+            "    tiny = 1.5e-300;\n"
+            "    someBool = false;\n"
+            "    \"quoted name\" = \"with \\\"escapes\\\" and ${refs}\";\n"
+            "    someRef = other.thing[3][\"key\"].value;\n"
+            "    someMacro = @Macro.Type someFunction(name: \"x\", obj: null, on: true);\n"
+            "    someArray = @V3f [ 1.0, 2.0, 3.0 ];\n"
+            "    nested = [ [], { }, [ 1, [ 2 ] ] ];\n"
+            "};\n"
+            "derived = : myValue { extra = 1; };\n";
+
+        File::FilePtr pText = new File(testInput, std::string("input"), ".", LoadOptions(false));
+
+        std::ostringstream binaryStream;
+        pText->writeBinary(binaryStream);
+        std::string binary = binaryStream.str();
+
+        File::FilePtr pBinary = new File(binary, std::string("input.rsdb"), ".", LoadOptions(false));
+
+        std::ostringstream textLocations, binaryLocations;
+        describeLocations(*pText, textLocations);
+        describeLocations(*pBinary, binaryLocations);
+
+        std::ostringstream rewritten;
+        pBinary->writeBinary(rewritten);
+
+        bool passed = true;
+        if (pText->str() != pBinary->str())
+        {
+            std::cerr << "FAILED: binary round trip changed the data:" << std::endl
+                      << pBinary->str() << std::endl;
+            passed = false;
+        }
+        if (textLocations.str() != binaryLocations.str())
+        {
+            std::cerr << "FAILED: binary round trip changed source locations" << std::endl;
+            passed = false;
+        }
+        if (rewritten.str() != binary)
+        {
+            std::cerr << "FAILED: rewriting the binary data was not stable" << std::endl;
+            passed = false;
+        }
+
+        // Binary data loads back through a stream too, read whole or in
+        // chunks, from a string or a file
+        pText->writeBinary("streamTest.rsdb");
+        for (size_t chunkSize = 0; chunkSize <= 64; chunkSize += 64)
+        {
+            LoadOptions streamOptions(false);
+            streamOptions.m_streamChunkSize = chunkSize;
+            std::istringstream stringStream(binary);
+            std::ifstream fileStream("streamTest.rsdb", std::ios::binary);
+            File::FilePtr pFromString = new File(stringStream, std::string("input.rsdb"), ".", streamOptions);
+            File::FilePtr pFromFile = new File(fileStream, std::string("input.rsdb"), ".", streamOptions);
+            if (pFromString->str() != pText->str() || pFromFile->str() != pText->str())
+            {
+                std::cerr << "FAILED: binary data read through a stream (chunk size " << chunkSize
+                          << ") changed the data" << std::endl;
+                passed = false;
+            }
+        }
+        std::remove("streamTest.rsdb");
+
+        // Damaged data must be rejected, not crash
+        for (size_t length = 0; length < binary.length(); ++length)
+        {
+            try
+            {
+                File::FilePtr pTruncated = new File(binary.substr(0, length), std::string("truncated"),
+                                                    ".", LoadOptions(false));
+                if (length >= 8)
+                {
+                    std::cerr << "FAILED: truncated binary data (" << length << " bytes) was accepted" << std::endl;
+                    passed = false;
+                }
+            }
+            catch (Parser::ParseException&)
+            {
+            }
+        }
+
+        std::cout << "// Round-tripped " << binary.length() << " bytes of binary:" << std::endl
+                  << pBinary->str() << std::endl;
+        return passed ? 0 : 1;
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+    }
+    return 1;
+}
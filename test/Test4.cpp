@@ -0,0 +1,155 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+#include <Rsd/FileWatcher.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+void writeFile(const std::string& filename, const std::string& contents)
+{
+    std::ofstream stream(filename.c_str());
+    stream << contents;
+}
+
+
+bool check(bool condition, const std::string& description)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << description << std::endl;
+    }
+    return condition;
+}
+
+
+long intValue(const File::FilePtr& pFile, const std::string& name)
+{
+    Value::Ptr pValue = pFile->Value::find(name);
+    return pValue ? pValue->asInteger() : -1;
+}
+
+}
+
+
+// Reload a scene after editing some of its files, and make sure only those
+// are parsed again and everything else keeps its identity
+int main(int argc, char **argv)
+{
+    const std::string rootFilename = "./reloadTest.rsd";
+    const std::string rigFilename = "./reloadTest.rig.rsd";
+    const std::string setFilename = "./reloadTest.set.rsd";
+    const std::string propsFilename = "./reloadTest.props.rsd";
+    const std::string spellingsFilename = "./reloadTest.spellings.rsd";
+    const std::string directoryName = "./reloadTest.dir";
+
+    bool passed = true;
+    try
+    {
+        writeFile(rigFilename, "keyLight = { intensity = 1; };\n");
+        writeFile(setFilename, "table = { legs = 4; };\n");
+        writeFile(propsFilename, "cup = { handles = 1; };\n");
+        writeFile(rootFilename,
+                  "include \"reloadTest.rig.rsd\";\n"
+                  "include \"reloadTest.set.rsd\";\n"
+                  "frame = 101;\n");
+
+        File::FilePtr pFile = new File(rootFilename);
+        Value::Ptr pRig = pFile->value(0);
+        Value::Ptr pSet = pFile->value(1);
+        Value::Ptr pTable = pFile->Value::find(std::string("table"));
+        FileWatcher watcher(pFile);
+
+        passed &= check(pFile->sourceFiles().size() == 3, "source files of the scene");
+        passed &= check(pFile->reload() == 0, "nothing reloaded before any edits");
+        passed &= check(watcher.poll(0) == 0, "watcher saw no edits");
+
+        // Edit one include; only it is parsed again, in place
+        writeFile(rigFilename, "keyLight = { intensity = 25; };\n");
+        size_t numReloaded = watcher.isNotified() ? watcher.poll(1000) : pFile->reload();
+        passed &= check(numReloaded == 1, "only the edited include reloaded");
+        passed &= check(intValue(pFile, "keyLight.intensity") == 25, "edited value visible");
+        passed &= check(pFile->value(0) == pRig, "edited include is still the same File");
+        passed &= check(pFile->Value::find(std::string("table")) == pTable, "untouched include kept its values");
+
+        // Edit the root to pull in another file; the existing includes are
+        // reattached as they are
+        writeFile(rootFilename,
+                  "include \"reloadTest.set.rsd\";\n"
+                  "include \"reloadTest.props.rsd\";\n"
+                  "include \"reloadTest.rig.rsd\";\n"
+                  "frame = 102;\n");
+        passed &= check(pFile->reload() == 1, "only the root reloaded");
+        passed &= check(intValue(pFile, "frame") == 102, "edited root value visible");
+        passed &= check(intValue(pFile, "cup.handles") == 1, "new include opened");
+        passed &= check(pFile->value(0) == pSet && pFile->value(2) == pRig, "includes reattached");
+        passed &= check(pFile->Value::find(std::string("table")) == pTable, "reattached include kept its values");
+        passed &= check(pFile->value(1)->file() == propsFilename, "new include numbered");
+        passed &= check(pTable->file() == setFilename, "reattached include still knows its file");
+
+        // A broken edit leaves the old contents alone
+        writeFile(setFilename, "table = { legs = ; };\n");
+        try
+        {
+            pFile->reload();
+            passed &= check(false, "parse error reported");
+        }
+        catch (Parser::ParseException&)
+        {
+        }
+        passed &= check(pFile->Value::find(std::string("table")) == pTable, "failed reload kept old values");
+
+        // The same directory reached through two spellings is watched once,
+        // and edits to files under either spelling are seen
+        mkdir(directoryName.c_str(), 0755);
+        writeFile(setFilename, "table = { legs = 4; };\n");
+        writeFile(spellingsFilename,
+                  "include \"reloadTest.rig.rsd\";\n"
+                  "include \"reloadTest.dir/../reloadTest.set.rsd\";\n");
+        File::FilePtr pSpellings = new File(spellingsFilename);
+        FileWatcher spellingsWatcher(pSpellings);
+        if (spellingsWatcher.isNotified())
+        {
+            writeFile(rigFilename, "keyLight = { intensity = 50; };\n");
+            passed &= check(spellingsWatcher.poll(1000) == 1, "watcher saw an edit under the first spelling");
+            passed &= check(intValue(pSpellings, "keyLight.intensity") == 50, "first spelling's edit visible");
+            writeFile(setFilename, "table = { legs = 3; };\n");
+            passed &= check(spellingsWatcher.poll(1000) == 1, "watcher saw an edit under the second spelling");
+            passed &= check(intValue(pSpellings, "table.legs") == 3, "second spelling's edit visible");
+        }
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+        passed = false;
+    }
+    catch (Exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        passed = false;
+    }
+
+    std::remove(rootFilename.c_str());
+    std::remove(rigFilename.c_str());
+    std::remove(setFilename.c_str());
+    std::remove(propsFilename.c_str());
+    std::remove(spellingsFilename.c_str());
+    rmdir(directoryName.c_str());
+
+    if (passed)
+    {
+        std::cout << "// Reloaded edited files in place" << std::endl;
+    }
+    return passed ? 0 : 1;
+}
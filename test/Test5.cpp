@@ -0,0 +1,107 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+bool sameBits(double a, double b)
+{
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+
+// Finite doubles from all over the range: raw bit patterns, values that look
+// like transform entries, and awkward ones near the limits
+std::vector<double> testValues()
+{
+    std::vector<double> values;
+    unsigned long long state = 0x2545F4914F6CDD1Dull;
+    while (values.size() < 20000)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        double d;
+        std::memcpy(&d, &state, sizeof(double));
+        if (std::isfinite(d))
+        {
+            values.push_back(d);
+        }
+        values.push_back(static_cast<double>(state % 2000001) / 1000.0 - 1000.0);
+        values.push_back(std::ldexp(static_cast<double>(state >> 11), -52));
+    }
+    const double special[] = { 0.0, -0.0, 0.1, 0.2, 0.3, 1.0 / 3.0, 2.0 / 3.0, 1e23, 8.98846567431158e307,
+                               1.7976931348623157e308, 2.2250738585072014e-308, 4.9406564584124654e-324,
+                               9007199254740993.0, 123456789012345678.0, 1e-7, 5e-324 };
+    values.insert(values.end(), special, special + sizeof(special) / sizeof(double));
+    return values;
+}
+
+}
+
+
+// Write floats out with Value::str() and parse them back, making sure every
+// one comes back with exactly the same bits
+int main(int argc, char **argv)
+{
+    std::vector<double> values = testValues();
+    std::ostringstream text;
+    text << "values = [ ";
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        Value::Ptr pValue = new Value(values[i]);
+        text << pValue->str() << (i + 1 < values.size() ? ", " : " ];\n");
+    }
+
+    size_t numMismatched = 0;
+    try
+    {
+        File::FilePtr pFile = new File(text.str(), "floatRoundTrip.rsd", ".", LoadOptions(false));
+        const ValueArray& parsed = pFile->value(0)->values();
+        if (parsed.size() != values.size())
+        {
+            std::cerr << "FAILED: parsed " << parsed.size() << " of " << values.size() << " values" << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (!parsed[i]->isFloat() || !sameBits(parsed[i]->asFloat(), values[i]))
+            {
+                if (numMismatched++ < 10)
+                {
+                    Value::Ptr pValue = new Value(values[i]);
+                    std::cerr << "FAILED: " << pValue->str() << " read back as " << parsed[i]->str() << std::endl;
+                }
+            }
+        }
+    }
+    catch (Parser::ParseException& pe)
+    {
+        std::cerr << pe.source() << ":" << pe.line() << ":" << pe.pos() << ": " << pe.what() << std::endl;
+        return 1;
+    }
+    catch (Exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (numMismatched > 0)
+    {
+        std::cerr << numMismatched << " of " << values.size() << " values did not round-trip" << std::endl;
+        return 1;
+    }
+    std::cout << "// Round-tripped " << values.size() << " floats through Value::str()" << std::endl;
+    return 0;
+}
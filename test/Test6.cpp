@@ -0,0 +1,98 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+#include "ParseTest.h"
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+// Parse text from a buffer, or from a stream in chunks of the given size,
+// giving the serialized tree and where each top-level value came from
+std::string parseText(const std::string& text, size_t streamChunkSize)
+{
+    LoadOptions options(false);
+    File::FilePtr pFile;
+    if (streamChunkSize == 0)
+    {
+        pFile = new File(text, "chunkTest.rsd", ".", options);
+    }
+    else
+    {
+        options.m_streamChunkSize = streamChunkSize;
+        std::istringstream stream(text);
+        pFile = new File(stream, std::string("chunkTest.rsd"), ".", options);
+    }
+    std::ostringstream result;
+    result << pFile->str();
+    for (size_t i = 0; i < pFile->size(); ++i)
+    {
+        result << " @" << pFile->value(i)->line() << ":" << pFile->value(i)->pos();
+    }
+    return result.str();
+}
+
+
+std::string readFile(const std::string& filename)
+{
+    std::ifstream stream(filename.c_str());
+    std::stringstream contents;
+    contents << stream.rdbuf();
+    return contents.str();
+}
+
+}
+
+
+// Parse the same text from a buffer and from a stream in chunks of a few
+// sizes, making sure each gives the same tree (or the same error), whichever
+// tokens, escapes, comments and line endings straddle the chunks
+int main(int argc, char **argv)
+{
+    std::vector<std::string> texts;
+    texts.push_back(readFile("testFile1.rsd"));
+    texts.push_back(readFile("testFile3.rsd"));
+    texts.push_back(readFile("testSchema1.rsd"));
+    texts.push_back("a = [1,2,3];b=.5;c=-1.25e-3;d=0x1F;e=true;f=a.b[0][\"x\"];");
+    texts.push_back("a = \"escaped \\\"quote\\\" and \\\\ backslash\"; b = \"// not a comment\";\n");
+    texts.push_back("// comment with \"quote\n  a = 1;// trailing\r\nb = \"{[;]}\"; c = 2;//end");
+    texts.push_back("longName = \"a string long enough to cross several sixteen byte chunks\";x=\"\";y = 1;");
+    texts.push_back("m = f(a: 1, b: g()); t = @A.\"B\" { s = \"\\n\"; }; u = :t { v = [ ]; };");
+    texts.push_back("a = [1.0, 2.0 3.0];");
+    texts.push_back("a = 1; / b = 2;");
+    texts.push_back("a = \"unterminated;\n b = 1;");
+    texts.push_back("a = 1; b = #;");
+    texts.push_back("a = 99999999999999999999;");
+    texts.push_back("");
+
+    // Every alignment of the same text against the 16-byte chunks
+    const std::string shifted = " = [ \"x\\\"y\", 1.5, a.b ]; // c\n";
+    for (size_t i = 0; i < 16; ++i)
+    {
+        texts.push_back(std::string(i, ' ') + "\"s\\\\\"" + shifted + "t" + shifted);
+    }
+
+    std::vector<ParseTest::Way> ways(1);
+    ways[0].m_name = "from a buffer";
+    ways[0].m_parse = [](const std::string& text) { return parseText(text, 0); };
+    const size_t chunkSizes[] = { 1, 7, 16, 4096 };
+    for (size_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); ++i)
+    {
+        size_t chunkSize = chunkSizes[i];
+        ParseTest::Way way;
+        std::ostringstream name;
+        name << "from a stream in " << chunkSize << "-byte chunks";
+        way.m_name = name.str();
+        way.m_parse = [chunkSize](const std::string& text) { return parseText(text, chunkSize); };
+        ways.push_back(way);
+    }
+    return ParseTest::compareParses(texts, "text", ways, "from buffers and streams in chunks");
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+const char* const kReferences[] =
+{
+    "a",
+    "a.b.c",
+    "shot.root",
+    "a.b[3][\"x\"]",
+    "geometry[0].file",
+    "lights[\"key\"].intensity"
+};
+const size_t kNumReferences = sizeof(kReferences) / sizeof(kReferences[0]);
+
+
+// Parse a reference with a parser, giving it back as text, or the error
+std::string parseReference(Parser::Parser& parser, const std::string& text)
+{
+    try
+    {
+        Reference::Ptr pRef(new Reference());
+        parser.parseReference(text, *pRef);
+        return pRef->str();
+    }
+    catch (Parser::ParseException& pe)
+    {
+        return std::string("error: ") + pe.description();
+    }
+}
+
+
+// Parse every reference a number of times with the parser, checking each
+// comes back as it went in; gives the number that did not
+size_t checkReferences(Parser::Parser& parser, size_t numTimes)
+{
+    size_t numFailed = 0;
+    for (size_t i = 0; i < numTimes; ++i)
+    {
+        for (size_t j = 0; j < kNumReferences; ++j)
+        {
+            std::string result = parseReference(parser, kReferences[j]);
+            if (result != kReferences[j])
+            {
+                std::cerr << "FAILED: reference " << kReferences[j] << " parsed as " << result << std::endl;
+                ++numFailed;
+            }
+        }
+    }
+    return numFailed;
+}
+
+}
+
+
+// Parse with reused contexts: the thread's default one, one given to the
+// parser, one per thread, and after parses that failed part way through
+int main(int argc, char **argv)
+{
+    size_t numFailed = 0;
+
+    // The thread's default context, over and over
+    Parser::Parser defaultParser;
+    numFailed += checkReferences(defaultParser, 100);
+
+    // A context of our own, shared by two parsers
+    Parser::ParseContext context;
+    Parser::Parser parser1, parser2;
+    parser1.setContext(&context);
+    parser2.setContext(&context);
+    numFailed += checkReferences(parser1, 10);
+    numFailed += checkReferences(parser2, 10);
+
+    // Errors part way through a parse must not upset the next one
+    const char* const badReferences[] = { "a.", "a[", "a.b[3]]", "[", "a..b" };
+    for (size_t i = 0; i < sizeof(badReferences) / sizeof(badReferences[0]); ++i)
+    {
+        std::string result = parseReference(parser1, badReferences[i]);
+        if (result.compare(0, 6, "error:") != 0)
+        {
+            std::cerr << "FAILED: bad reference " << badReferences[i] << " parsed as " << result << std::endl;
+            ++numFailed;
+        }
+        numFailed += checkReferences(parser1, 1);
+    }
+
+    // Files and references through the same context, in turn
+    for (size_t i = 0; i < 10; ++i)
+    {
+        File::FilePtr pFile = new File("a = { b = [1, 2, 3]; c = \"x\"; }; d = a.b[1];",
+                                       "contextTest.rsd", ".", LoadOptions(false));
+        Value::Ptr pValue = pFile->find(*Reference::fromString("a.b[2]"));
+        if (!pValue || pValue->asInteger() != 3)
+        {
+            std::cerr << "FAILED: a.b[2] not found in file " << i << std::endl;
+            ++numFailed;
+        }
+        numFailed += checkReferences(defaultParser, 1);
+    }
+
+    // Each thread parses with its own default context
+    const size_t kNumThreads = 4;
+    std::vector<size_t> threadFailures(kNumThreads, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kNumThreads; ++i)
+    {
+        threads.push_back(std::thread([&threadFailures, i]()
+        {
+            Parser::Parser threadParser;
+            threadFailures[i] = checkReferences(threadParser, 1000);
+        }));
+    }
+    for (size_t i = 0; i < kNumThreads; ++i)
+    {
+        threads[i].join();
+        numFailed += threadFailures[i];
+    }
+
+    if (numFailed > 0)
+    {
+        std::cerr << numFailed << " parses with reused contexts failed" << std::endl;
+        return 1;
+    }
+    std::cout << "// All parses with reused contexts succeeded" << std::endl;
+    return 0;
+}
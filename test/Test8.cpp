@@ -0,0 +1,138 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+#include "ParseTest.h"
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+// Where a value and everything in it came from
+void describeSources(const Value& value, std::ostream& result)
+{
+    result << value.file() << ":" << value.line() << ":" << value.pos() << " ";
+    for (size_t i = 0; i < value.values().size(); ++i)
+    {
+        describeSources(*value.values()[i], result);
+    }
+}
+
+
+// Parse text on some number of threads, giving the serialized tree and where
+// each value came from
+std::string parseText(const std::string& text, size_t parseThreads)
+{
+    LoadOptions options(true);
+    options.m_parseThreads = parseThreads;
+    File::FilePtr pFile = new File(text, "parallelTest.rsd", ".", options);
+    std::ostringstream result;
+    result << pFile->str(true);
+    describeSources(*pFile, result);
+    return result.str();
+}
+
+
+// A scene big enough to be split, full of semicolons and brackets that are
+// not where values end; entry i is spliced in before value i
+std::string generateScene(size_t numValues, const std::vector<std::string>& entries)
+{
+    std::ostringstream text;
+    for (size_t i = 0; i < numValues; ++i)
+    {
+        if (i < entries.size())
+        {
+            text << entries[i];
+        }
+        switch (i % 5)
+        {
+        case 0:
+            text << "v" << i << " = @Mesh { points = [1.5, 2, -3e2]; name = \"{a; b]\"; };\n";
+            break;
+        case 1:
+            text << "// a comment; with { brackets\r\nv" << i << " = \"quote \\\" ; } \\\\\";\n";
+            break;
+        case 2:
+            text << "\"v" << i << "\" = m(a: 1, b: [x.y[0], \"z;\"]);  ";
+            break;
+        case 3:
+            text << "v" << i << " = :v" << (i - 3) << " { c = v" << (i - 2) << "; d = { e = [ [ ], { } ]; }; };\n";
+            break;
+        default:
+            text << "v" << i << " = w.x[\"y\"][3];\n";
+            break;
+        }
+    }
+    return text.str();
+}
+
+}
+
+
+// Parse big scenes on several threads and on one, making sure they give the
+// same tree, sources and errors
+int main(int argc, char **argv)
+{
+    const size_t kNumValues = 20000;
+
+    std::vector< std::vector<std::string> > variants;
+    variants.push_back(std::vector<std::string>());
+
+    std::vector<std::string> includes(kNumValues);
+    includes[10] = "include \"whatever.rsd\";\n";
+    includes[kNumValues / 2] = "n = { m = { include \"whatever.rsd\"; }; };\n";
+    includes[kNumValues - 1] = "o = [ { include \"whatever.rsd\"; } ];\n";
+    variants.push_back(includes);
+
+    std::vector<std::string> syntaxError(kNumValues);
+    syntaxError[kNumValues / 2] = "bad = [1, 2;\n";
+    variants.push_back(syntaxError);
+
+    std::vector<std::string> laterErrors(kNumValues);
+    laterErrors[kNumValues / 3] = "v5 = 1;\n";
+    laterErrors[kNumValues / 2] = "u = #;\n";
+    variants.push_back(laterErrors);
+
+    std::vector<std::string> duplicates(kNumValues);
+    duplicates[kNumValues / 3] = "v5 = 1;\n";
+    duplicates[kNumValues / 2] = "v7 = 1;\n";
+    variants.push_back(duplicates);
+
+    std::vector<std::string> unterminated(kNumValues);
+    unterminated[kNumValues / 4] = "s = \"no end;\n";
+    variants.push_back(unterminated);
+
+    std::vector<std::string> unbalanced(kNumValues);
+    unbalanced[kNumValues / 4] = "} ";
+    variants.push_back(unbalanced);
+
+    std::vector<std::string> unclosed(kNumValues);
+    unclosed[kNumValues - 1] = "b = { c = 1;\n";
+    variants.push_back(unclosed);
+
+    std::vector<std::string> scenes;
+    for (size_t i = 0; i < variants.size(); ++i)
+    {
+        scenes.push_back(generateScene(kNumValues, variants[i]));
+    }
+
+    std::vector<ParseTest::Way> ways(1);
+    ways[0].m_name = "on one thread";
+    ways[0].m_parse = [](const std::string& text) { return parseText(text, 0); };
+    for (size_t numThreads = 2; numThreads <= 8; numThreads *= 2)
+    {
+        ParseTest::Way way;
+        std::ostringstream name;
+        name << "on " << numThreads << " threads";
+        way.m_name = name.str();
+        way.m_parse = [numThreads](const std::string& text) { return parseText(text, numThreads); };
+        ways.push_back(way);
+    }
+    return ParseTest::compareParses(scenes, "scene", ways, "on one and several threads");
+}
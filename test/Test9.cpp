@@ -0,0 +1,110 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Rsd/Parser.h>
+#include <Rsd/File.h>
+
+
+using namespace RenderSpud::Rsd;
+
+
+namespace
+{
+
+// Look up many different references through the cache (more than it
+// holds), checking each against a fresh parse; gives the number that differ
+size_t checkCachedReferences(size_t numReferences, size_t seed)
+{
+    size_t numFailed = 0;
+    for (size_t i = 0; i < numReferences; ++i)
+    {
+        std::ostringstream text;
+        text << "a" << (i + seed) % numReferences << ".b[" << i % 7 << "][\"c\"]";
+        Reference::ConstPtr pCached = Reference::fromStringCached(text.str());
+        if (!pCached || pCached->str() != Reference::fromString(text.str())->str())
+        {
+            std::cerr << "FAILED: cached reference " << text.str() << " came back as "
+                      << (pCached ? pCached->str() : std::string("nothing")) << std::endl;
+            ++numFailed;
+        }
+    }
+    return numFailed;
+}
+
+}
+
+
+// References from the cache: shared, bounded, correct across threads, and
+// resolving the same in every context they are interpolated in
+int main(int argc, char **argv)
+{
+    size_t numFailed = 0;
+
+    // The same string gives the same reference
+    Reference::ConstPtr pFirst = Reference::fromStringCached("shot.root");
+    Reference::ConstPtr pSecond = Reference::fromStringCached("shot.root");
+    if (pFirst.get() != pSecond.get() || pFirst->str() != "shot.root")
+    {
+        std::cerr << "FAILED: shot.root was not shared from the cache" << std::endl;
+        ++numFailed;
+    }
+
+    // Bad references throw every time, not just the first
+    for (size_t i = 0; i < 2; ++i)
+    {
+        try
+        {
+            Reference::fromStringCached("a.[");
+            std::cerr << "FAILED: bad reference parsed from the cache" << std::endl;
+            ++numFailed;
+        }
+        catch (Parser::ParseException&)
+        {
+        }
+    }
+
+    // More references than the cache holds, from several threads at once
+    const size_t kNumThreads = 4;
+    std::vector<size_t> threadFailures(kNumThreads, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kNumThreads; ++i)
+    {
+        threads.push_back(std::thread([&threadFailures, i]()
+        {
+            threadFailures[i] = checkCachedReferences(10000, i * 1000);
+        }));
+    }
+    for (size_t i = 0; i < kNumThreads; ++i)
+    {
+        threads[i].join();
+        numFailed += threadFailures[i];
+    }
+
+    // The same interpolated references resolve against the context of each
+    // string using them, subscripts and all
+    File::FilePtr pFile = new File("i = 0; names = [\"x\", \"y\"];\n"
+                                   "a = { i = 1; s = \"${i}${names[i]}\"; };\n"
+                                   "b = { s = \"${i}${names[i]}\"; };\n",
+                                   "cacheTest.rsd", ".", LoadOptions(false));
+    for (size_t i = 0; i < 3; ++i)
+    {
+        std::string a = pFile->value("a")->value("s")->asString();
+        std::string b = pFile->value("b")->value("s")->asString();
+        if (a != "1x" || b != "0x")
+        {
+            std::cerr << "FAILED: interpolated ${i}${names[i]} gave " << a << " and " << b << std::endl;
+            ++numFailed;
+        }
+    }
+
+    if (numFailed > 0)
+    {
+        std::cerr << numFailed << " cached reference checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "// All cached references matched" << std::endl;
+    return 0;
+}